@@ -2,6 +2,30 @@
 
 namespace eosio {
 
+namespace {
+
+checksum256 hash_pair( const checksum256& left, const checksum256& right )
+{
+    std::array<char, 64> buf;
+    auto l = left.extract_as_byte_array();
+    auto r = right.extract_as_byte_array();
+    std::copy( l.begin(), l.end(), buf.begin() );
+    std::copy( r.begin(), r.end(), buf.begin() + 32 );
+    return sha256( buf.data(), buf.size() );
+}
+
+checksum256 hash_drop_leaf( uint64_t index, const name& account, int64_t amount )
+{
+    std::array<char, 24> buf;
+    uint64_t fields[3] = { index, account.value, static_cast<uint64_t>( amount ) };
+    for( size_t f = 0; f < 3; ++f )
+        for( size_t b = 0; b < 8; ++b )
+            buf[f * 8 + b] = static_cast<char>( fields[f] >> ( 8 * b ) );
+    return sha256( buf.data(), buf.size() );
+}
+
+}
+
 void token::create( const name&   issuer,
                     const asset&  maximum_supply )
 {
@@ -11,84 +35,91 @@ void token::create( const name&   issuer,
     check( sym.is_valid(), "invalid symbol name" );
     check( maximum_supply.is_valid(), "invalid supply");
     check( maximum_supply.amount > 0, "max-supply must be positive");
-    check( maximum_supply.amount >= (maxAirdrop+maxIco+maxPreIco+maxHistory_s_h+maxInb+maxStakingCoin+maxHistory_n_l_s+maxddsfundation+maxMarket_ad+maxMan_team+maxOpt_cost+maxHistory_s_f), "max-supply must be greater than allocated transfers summation");
+    check( maximum_supply.amount >= default_allocated_supply(), "max-supply must be greater than allocated transfers summation");
     stats statstable( get_self(), sym.code().raw() );
     auto existing = statstable.find( sym.code().raw() );
     check( existing == statstable.end(), "token with symbol already exists" );
+    legacy_stats legacytable( get_self(), sym.code().raw() );
+    check( legacytable.find( sym.code().raw() ) == legacytable.end(), "token with symbol already exists" );
     statstable.emplace( get_self(), [&]( auto& s ) {
-       s.supply.symbol = maximum_supply.symbol;
-       s.cir_supply.symbol = maximum_supply.symbol;
-       s.burn_supply.symbol = maximum_supply.symbol;
-       s.block_supply.symbol    = maximum_supply.symbol;
-        s.max_supply    = maximum_supply;
-        s.available_supply    = maximum_supply;
-
-        s.max_airdrop_supply.symbol = maximum_supply.symbol;
-        s.max_airdrop_supply.amount = maxAirdrop;
-        s.airdrop_supply.symbol = maximum_supply.symbol;
-
-        s.max_ico_supply.symbol = maximum_supply.symbol;
-        s.max_ico_supply.amount = maxIco;
-        s.ico_supply.symbol = maximum_supply.symbol;
-
-        s.max_pre_ico_supply.symbol = maximum_supply.symbol;
-        s.max_pre_ico_supply.amount = maxPreIco;
-        s.pre_ico_supply.symbol = maximum_supply.symbol;
-
-           s.max_history_s_h_supply.symbol = maximum_supply.symbol;
-        s.max_history_s_h_supply.amount = maxHistory_s_h;
-        s.history_s_h_supply.symbol = maximum_supply.symbol;
-
-
-        s.max_inb_supply.symbol = maximum_supply.symbol;
-        s.max_inb_supply.amount = maxInb;
-        s.inb_supply.symbol = maximum_supply.symbol;
-
-       s.max_staking_supply.symbol = maximum_supply.symbol;
-       s.max_staking_supply.amount = maxStakingCoin;
-       s.staking_supply.symbol = maximum_supply.symbol;
-
-        s.max_history_n_l_s_supply.symbol = maximum_supply.symbol;
-        s.max_history_n_l_s_supply.amount = maxHistory_n_l_s;
-        s.history_n_l_s_supply.symbol = maximum_supply.symbol;
-
-        s.max_ddsfundation_supply.symbol = maximum_supply.symbol;
-        s.max_ddsfundation_supply.amount = maxddsfundation;
-        s.ddsfundation_supply.symbol = maximum_supply.symbol;
-
-        s.max_market_ad_supply.symbol = maximum_supply.symbol;
-        s.max_market_ad_supply.amount = maxMarket_ad;
-        s.market_ad_supply.symbol = maximum_supply.symbol;
-
-
-        s.max_man_team_supply.symbol = maximum_supply.symbol;
-        s.max_man_team_supply.amount = maxMan_team;
-        s.man_team_supply.symbol = maximum_supply.symbol;
-
-        s.max_opt_cost_supply.symbol = maximum_supply.symbol;
-        s.max_opt_cost_supply.amount = maxOpt_cost;
-        s.opt_cost_supply.symbol = maximum_supply.symbol;
+       s.sym              = maximum_supply.symbol;
+       s.max_supply       = maximum_supply.amount;
+       s.available_supply = maximum_supply.amount;
+       s.issuer           = issuer;
+    });
 
-        s.max_history_s_f_supply.symbol = maximum_supply.symbol;
-        s.max_history_s_f_supply.amount = maxHistory_s_f;
-        s.history_s_f_supply.symbol = maximum_supply.symbol;
+    register_symbol( maximum_supply.symbol );
 
-       s.lock_time_history_sh = history_sh_function_time_lock;
+    tranches tranchetable( get_self(), sym.code().raw() );
+    for( const auto& d : default_tranches ) {
+       tranchetable.emplace( get_self(), [&]( auto& t ) {
+          t.id          = d.id;
+          t.wallet      = d.wallet;
+          t.max_supply  = d.max_supply;
+          t.unlock_time = d.unlock_time;
+          t.lock_time   = d.lock_time;
+       });
+    }
+}
 
-        s.lock_time_inb = inb_function_time_lock;
-       s.last_time_inb = 0;
+void token::convertstat( const symbol_code& sym_code )
+{
+    require_auth( get_self() );
 
-       s.lock_time_ddsfundation = ddsfundation_function_time_lock;
-       s.last_time_ddsfundation=0;
+    legacy_stats legacytable( get_self(), sym_code.raw() );
+    const auto& old = legacytable.get( sym_code.raw(), "token has no stat row to convert" );
+    stats statstable( get_self(), sym_code.raw() );
+    check( statstable.find( sym_code.raw() ) == statstable.end(), "token with symbol already converted" );
 
-       s.lock_time_market_ad = market_ad_function_time_lock;
-       s.last_time_market_ad=0;
+    statstable.emplace( get_self(), [&]( auto& s ) {
+       s.sym              = old.supply.symbol;
+       s.cir_supply       = old.cir_supply.amount;
+       s.available_supply = old.available_supply.amount;
+       s.max_supply       = old.max_supply.amount;
+       s.supply           = old.supply.amount;
+       s.burn_supply      = old.burn_supply.amount;
+       s.block_supply     = old.block_supply.amount;
+       s.issuer           = old.issuer;
+    });
 
-       s.lock_time_man_team = man_team_function_time_lock;
-       s.last_time_man_team=0;
+    struct legacy_tranche {
+       const asset&  supply;
+       const asset&  max_supply;
+       uint64_t      unlock_time;
+       uint64_t      lock_time;
+       uint64_t      last_time;
+    };
+    // same order as default_tranches, which supply the wallets
+    const std::array<legacy_tranche, default_tranches.size()> legacy = {{
+       { old.airdrop_supply,       old.max_airdrop_supply,       0, 0, 0 },
+       { old.ico_supply,           old.max_ico_supply,           0, 0, 0 },
+       { old.pre_ico_supply,       old.max_pre_ico_supply,       0, 0, 0 },
+       { old.history_s_h_supply,   old.max_history_s_h_supply,   old.lock_time_history_sh, 0, 0 },
+       { old.inb_supply,           old.max_inb_supply,           0, old.lock_time_inb, old.last_time_inb },
+       { old.staking_supply,       old.max_staking_supply,       0, 0, 0 },
+       { old.history_n_l_s_supply, old.max_history_n_l_s_supply, 0, 0, 0 },
+       { old.ddsfundation_supply,  old.max_ddsfundation_supply,  0, old.lock_time_ddsfundation, old.last_time_ddsfundation },
+       { old.market_ad_supply,     old.max_market_ad_supply,     0, old.lock_time_market_ad, old.last_time_market_ad },
+       { old.man_team_supply,      old.max_man_team_supply,      0, static_cast<uint64_t>( old.lock_time_man_team ), old.last_time_man_team },
+       { old.opt_cost_supply,      old.max_opt_cost_supply,      0, 0, 0 },
+       { old.history_s_f_supply,   old.max_history_s_f_supply,   0, 0, 0 }
+    }};
+
+    tranches tranchetable( get_self(), sym_code.raw() );
+    for( size_t i = 0; i < default_tranches.size(); ++i ) {
+       tranchetable.emplace( get_self(), [&]( auto& t ) {
+          t.id          = default_tranches[i].id;
+          t.wallet      = default_tranches[i].wallet;
+          t.max_supply  = legacy[i].max_supply.amount;
+          t.supply      = legacy[i].supply.amount;
+          t.unlock_time = legacy[i].unlock_time;
+          t.lock_time   = legacy[i].lock_time;
+          t.last_time   = legacy[i].last_time;
+       });
+    }
 
-       s.issuer        = issuer;
-    });
+    register_symbol( old.supply.symbol );
+    legacytable.erase( old );
 }
 
 void token::burn( const asset& quantity, const string& memo )
@@ -106,16 +137,18 @@ void token::burn( const asset& quantity, const string& memo )
     check( quantity.is_valid(), "invalid quantity" );
     check( quantity.amount > 0, "must retire positive quantity" );
 
-    check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
-    check( quantity.amount <= st.cir_supply.amount , "quantity exceeds available circulating supply");
+    check( quantity.symbol == st.sym, "symbol precision mismatch" );
+    auto totals = st.totals();
+    check_rule( token_rules::check_retire( totals, quantity.amount ) );
+    token_rules::apply_burn( totals, quantity.amount );
 
     statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.cir_supply -= quantity;
-       s.available_supply -= quantity;
-       s.burn_supply += quantity;
+       s.set_totals( totals );
     });
+    record_checkpoint( st );
 
     sub_balance( st.issuer, quantity );
+    log_activity( burn_activity, st.issuer, name(), quantity );
 }
 
 void token::transfer( const name&    from,
@@ -127,29 +160,337 @@ void token::transfer( const name&    from,
     require_auth( from );
     check( is_account( to ), "to account does not exist");
     auto sym = quantity.symbol.code();
-    stats statstable( get_self(), sym.raw() );
-    const auto& st = statstable.get( sym.raw() );
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( sym.raw(), "token with symbol does not exist" );
 
     require_recipient( from );
     require_recipient( to );
 
     check( quantity.is_valid(), "invalid quantity" );
     check( quantity.amount > 0, "must transfer positive quantity" );
-    check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+    check( quantity.symbol == ts.sym, "symbol precision mismatch" );
     check( memo.size() <= 256, "memo has more than 256 bytes" );
 
     auto payer = has_auth( to ) ? to : from;
 
     sub_balance( from, quantity );
     add_balance( to, quantity, payer );
+    log_activity( transfer_activity, from, to, quantity );
+}
+
+void token::xfer( const name&    from,
+                  const name&    to,
+                  int64_t        amount,
+                  bool           notify )
+{
+    check( from != to, "cannot transfer to self" );
+    require_auth( from );
+    check( is_account( to ), "to account does not exist");
+    check( amount > 0, "must transfer positive quantity" );
+
+    asset quantity( amount, deployed_symbol() );
+    check( quantity.is_valid(), "invalid quantity" );
+
+    if( notify ) {
+       require_recipient( from );
+       require_recipient( to );
+    }
+
+    auto payer = has_auth( to ) ? to : from;
+
+    sub_balance( from, quantity );
+    add_balance( to, quantity, payer );
+    log_activity( transfer_activity, from, to, quantity );
+}
+
+void token::settle( const std::vector<std::pair<name, int64_t>>& deltas )
+{
+    check( !deltas.empty(), "no deltas provided" );
+    auto sym = deployed_symbol();
+
+    int128_t net = 0;
+    name payer;
+    for( size_t i = 0; i < deltas.size(); ++i ) {
+        const auto& d = deltas[i];
+        check( i == 0 || deltas[i - 1].first < d.first, "accounts must be sorted and unique" );
+        check( d.second != 0, "delta must not be zero" );
+        check( asset( d.second, sym ).is_amount_within_range(), "delta out of range" );
+        if( d.second < 0 ) {
+            require_auth( d.first );
+            if( payer == name() )
+               payer = d.first;
+        } else {
+            check( is_account( d.first ), "to account does not exist");
+        }
+        net += d.second;
+    }
+    check( net == 0, "deltas must sum to zero" );
+
+    for( const auto& d : deltas ) {
+        require_recipient( d.first );
+        if( d.second < 0 ) {
+           sub_balance( d.first, asset( -d.second, sym ) );
+           log_activity( settle_activity, d.first, name(), asset( -d.second, sym ) );
+        }
+    }
+    for( const auto& d : deltas ) {
+        if( d.second > 0 ) {
+           add_balance( d.first, asset( d.second, sym ), has_auth( d.first ) ? d.first : payer );
+           log_activity( settle_activity, name(), d.first, asset( d.second, sym ) );
+        }
+    }
+}
+
+void token::transferbatch( const name&                                from,
+                           const std::vector<std::pair<name, asset>>& transfers,
+                           const string&                              memo )
+{
+    require_auth( from );
+    check( !transfers.empty(), "no transfers provided" );
+    check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    auto sym = transfers.front().second.symbol;
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( sym.code().raw(), "token with symbol does not exist" );
+    check( sym == ts.sym, "symbol precision mismatch" );
+
+    asset total( 0, sym );
+    for( const auto& t : transfers ) {
+        check( t.first != from, "cannot transfer to self" );
+        check( t.second.symbol == sym, "symbol precision mismatch" );
+        check( t.second.is_valid(), "invalid quantity" );
+        check( t.second.amount > 0, "must transfer positive quantity" );
+        total += t.second;
+    }
+
+    require_recipient( from );
+    sub_balance( from, total );
+
+    for( const auto& t : transfers ) {
+        check( is_account( t.first ), "to account does not exist");
+        require_recipient( t.first );
+        auto payer = has_auth( t.first ) ? t.first : from;
+        add_balance( t.first, t.second, payer );
+        log_activity( transfer_activity, from, t.first, t.second );
+    }
+}
+
+void token::lock( const name&    from,
+                  const name&    to,
+                  const asset&   quantity,
+                  uint64_t       unlock_time )
+{
+    require_auth( from );
+    check( is_account( to ), "to account does not exist");
+    check( quantity.is_valid(), "invalid quantity" );
+    check( quantity.amount > 0, "must lock positive quantity" );
+    check( unlock_time > current_time_point().sec_since_epoch(), "unlock time must be in the future" );
+
+    auto sym = quantity.symbol.code();
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( sym.raw(), "token with symbol does not exist" );
+    check( quantity.symbol == ts.sym, "symbol precision mismatch" );
+
+    if( from != to && !has_auth( to ) ) {
+       stats statstable( get_self(), sym.raw() );
+       const auto& st = statstable.get( sym.raw(), "token with symbol does not exist" );
+       check( from == st.issuer, "locking on another account requires its authorization" );
+    }
+
+    // Expired locks no longer count toward the limit, they are dropped here as well as on spending.
+    uint64_t now = current_time_point().sec_since_epoch();
+    locks locktable( get_self(), to.value );
+    uint32_t count = 0;
+    for( auto itr = locktable.begin(); itr != locktable.end(); ) {
+       if( itr->unlock_time <= now ) {
+          itr = locktable.erase( itr );
+       } else {
+          ++count;
+          ++itr;
+       }
+    }
+    check( count < max_locks, "too many locks on account" );
+
+    if( from == to ) {
+       accounts acnts( get_self(), to.value );
+       const auto& ac = acnts.get( sym.raw(), "no balance object found" );
+       check( ac.balance.amount - locked_balance( to, quantity.symbol ) >= quantity.amount, "overdrawn balance" );
+    } else {
+       require_recipient( from );
+       require_recipient( to );
+       sub_balance( from, quantity );
+       add_balance( to, quantity, from );
+       log_activity( transfer_activity, from, to, quantity );
+    }
+
+    locktable.emplace( from, [&]( auto& l ) {
+       l.id          = locktable.available_primary_key();
+       l.quantity    = quantity;
+       l.unlock_time = unlock_time;
+    });
+}
+
+void token::createstream( const name&    payer,
+                          const name&    payee,
+                          const asset&   rate,
+                          uint64_t       start,
+                          uint64_t       stop )
+{
+    require_auth( payer );
+    check( payer != payee, "cannot stream to self" );
+    check( payer != get_self() && payee != get_self(), "contract account cannot take part in a stream" );
+    check( is_account( payee ), "payee account does not exist" );
+    check( rate.is_valid(), "invalid rate" );
+    check( rate.amount > 0, "must stream positive rate" );
+    check( stop > start, "stream must stop after it starts" );
+    check( stop > current_time_point().sec_since_epoch(), "stream must stop in the future" );
+    check( stop - start <= static_cast<uint64_t>( asset::max_amount / rate.amount ), "stream deposit overflow" );
+
+    auto sym = rate.symbol.code();
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( sym.raw(), "token with symbol does not exist" );
+    check( rate.symbol == ts.sym, "symbol precision mismatch" );
+
+    require_recipient( payer );
+    require_recipient( payee );
+
+    streams streamtable( get_self(), get_self().value );
+    auto itr = streamtable.emplace( payer, [&]( auto& p ) {
+       p.id        = streamtable.available_primary_key();
+       p.payer     = payer;
+       p.payee     = payee;
+       p.rate      = rate;
+       p.start     = start;
+       p.stop      = stop;
+       p.withdrawn = asset( 0, rate.symbol );
+    });
+
+    auto deposit = itr->deposit();
+    sub_balance( payer, deposit );
+    add_balance( get_self(), deposit, payer );
+    update_escrow( deposit );
+    log_activity( stream_activity, payer, get_self(), deposit );
+}
+
+void token::withdraw( uint64_t id )
+{
+    streams streamtable( get_self(), get_self().value );
+    const auto& ps = streamtable.get( id, "stream does not exist" );
+    require_auth( ps.payee );
+
+    auto owed = ps.accrued( current_time_point().sec_since_epoch() ) - ps.withdrawn;
+    check( owed.amount > 0, "nothing to withdraw" );
+
+    require_recipient( ps.payer );
+    require_recipient( ps.payee );
+
+    update_escrow( -owed );
+    sub_balance( get_self(), owed );
+    add_balance( ps.payee, owed, ps.payee );
+    log_activity( stream_activity, get_self(), ps.payee, owed );
+
+    if( ps.withdrawn + owed == ps.deposit() ) {
+       streamtable.erase( ps );
+       return;
+    }
+    streamtable.modify( ps, same_payer, [&]( auto& p ) {
+       p.withdrawn += owed;
+    });
+}
+
+void token::cancelstream( uint64_t id, const name& canceller )
+{
+    require_auth( canceller );
+    streams streamtable( get_self(), get_self().value );
+    const auto& ps = streamtable.get( id, "stream does not exist" );
+    check( canceller == ps.payer || canceller == ps.payee, "only the payer or payee may cancel a stream" );
+
+    require_recipient( ps.payer );
+    require_recipient( ps.payee );
+
+    auto accrued = ps.accrued( current_time_point().sec_since_epoch() );
+    auto owed = accrued - ps.withdrawn;
+    auto refund = ps.deposit() - accrued;
+    update_escrow( -( owed + refund ) );
+    if( owed.amount > 0 ) {
+       sub_balance( get_self(), owed );
+       add_balance( ps.payee, owed, canceller );
+       log_activity( stream_activity, get_self(), ps.payee, owed );
+    }
+    if( refund.amount > 0 ) {
+       sub_balance( get_self(), refund );
+       add_balance( ps.payer, refund, canceller );
+       log_activity( stream_activity, get_self(), ps.payer, refund );
+    }
+    streamtable.erase( ps );
+}
+
+void token::open( const name& owner, const symbol& symbol, const name& ram_payer )
+{
+   require_auth( ram_payer );
+   check( is_account( owner ), "owner account does not exist" );
+
+   auto sym_code_raw = symbol.code().raw();
+   symbols symtable( get_self(), get_self().value );
+   const auto& ts = symtable.get( sym_code_raw, "symbol does not exist" );
+   check( ts.sym == symbol, "symbol precision mismatch" );
+
+   accounts acnts( get_self(), owner.value );
+   auto it = acnts.find( sym_code_raw );
+   if( it == acnts.end() ) {
+      acnts.emplace( ram_payer, [&]( auto& a ){
+        a.balance = asset{0, symbol};
+      });
+   }
+}
+
+void token::close( const name& owner, const symbol& symbol )
+{
+   require_auth( owner );
+   accounts acnts( get_self(), owner.value );
+   auto it = acnts.find( symbol.code().raw() );
+   check( it != acnts.end(), "Balance row already deleted or never existed. Action won't have any effect." );
+   check( it->balance.amount == 0, "Cannot close because the balance is not zero." );
+   acnts.erase( it );
+}
+
+symbol token::deployed_symbol()const
+{
+   symbols symtable( get_self(), get_self().value );
+   auto itr = symtable.begin();
+   check( itr != symtable.end(), "token with symbol does not exist" );
+   auto sym = itr->sym;
+   check( ++itr == symtable.end(), "action requires a single token deployment" );
+   return sym;
+}
+
+void token::register_symbol( const symbol& sym )
+{
+   symbols symtable( get_self(), get_self().value );
+   if( symtable.find( sym.code().raw() ) != symtable.end() )
+      return;
+   symtable.emplace( get_self(), [&]( auto& s ) {
+      s.sym = sym;
+   });
 }
 
 void token::sub_balance( const name& owner, const asset& value ) {
    accounts from_acnts( get_self(), owner.value );
 
    const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
-   check( from.balance.amount >= value.amount, "overdrawn balance" );
+   int64_t reserved = locked_balance( owner, value.symbol );
+   if( owner == get_self() )
+      reserved += escrowed_balance( value.symbol );
+   check_rule( token_rules::check_debit( from.balance.amount, reserved, value.amount ) );
 
+   update_holder( owner, from.balance - value, owner );
+
+#ifdef TOKEN_AUTO_CLOSE
+   if( from.balance.amount == value.amount ) {
+      from_acnts.erase( from );
+      return;
+   }
+#endif
    from_acnts.modify( from, owner, [&]( auto& a ) {
          a.balance -= value;
       });
@@ -163,359 +504,571 @@ void token::add_balance( const name& owner, const asset& value, const name& ram_
       to_acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = value;
       });
+      update_holder( owner, value, ram_payer );
    } else {
       to_acnts.modify( to, same_payer, [&]( auto& a ) {
         a.balance += value;
       });
+      update_holder( owner, to->balance, ram_payer );
    }
 }
 
-void token::tairdrop(const asset& quantity){
-    require_auth( get_self() );
-    const name & to = name(airdrop_wallet);
-    auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
-
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
-
-    check( quantity.symbol == st.max_airdrop_supply.symbol, "symbol precision mismatch" );
-    check( st.max_airdrop_supply.amount >= st.airdrop_supply.amount, "All Airdrop Tokens are transferred" );
-    check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_airdrop_supply.amount - st.airdrop_supply.amount, "quantity exceeds available Airdrop supply");
+int64_t token::locked_balance( const name& owner, const symbol& sym )
+{
+   locks locktable( get_self(), owner.value );
+   auto itr = locktable.begin();
+   if( itr == locktable.end() )
+      return 0;
+
+   // Expired locks are only dropped here, the first time the owner spends after they expire.
+   uint64_t now = current_time_point().sec_since_epoch();
+   int64_t locked = 0;
+   while( itr != locktable.end() ) {
+      if( itr->quantity.symbol != sym ) {
+         ++itr;
+      } else if( itr->unlock_time <= now ) {
+         itr = locktable.erase( itr );
+      } else {
+         locked += itr->quantity.amount;
+         ++itr;
+      }
+   }
+   return locked;
+}
 
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.airdrop_supply += quantity;
-       s.supply += quantity;
-       s.cir_supply +=quantity;
-       });
+int64_t token::escrowed_balance( const symbol& sym )
+{
+   escrows escrowtable( get_self(), get_self().value );
+   auto itr = escrowtable.find( sym.code().raw() );
+   return itr == escrowtable.end() ? 0 : itr->balance.amount;
+}
 
-       add_balance( to, quantity, get_self() );
+void token::update_escrow( const asset& delta )
+{
+   escrows escrowtable( get_self(), get_self().value );
+   auto itr = escrowtable.find( delta.symbol.code().raw() );
+   if( itr == escrowtable.end() ) {
+      escrowtable.emplace( get_self(), [&]( auto& e ) {
+         e.balance = delta;
+      });
+   } else {
+      escrowtable.modify( itr, same_payer, [&]( auto& e ) {
+         e.balance += delta;
+      });
+   }
+}
 
+#ifdef TOKEN_ACTIVITY_LOG
+void token::log_activity( activity_kind kind, const name& from, const name& to, const asset& quantity )
+{
+   if( !activity_pending )
+      activity_pending = activity_cursor( get_self(), get_self().value ).get_or_default();
+   auto& state = *activity_pending;
+
+   activity_log log( get_self(), get_self().value );
+   uint64_t slot = state.next_seq % activity_log_size;
+   auto write = [&]( auto& r ) {
+      r.slot     = slot;
+      r.seq      = state.next_seq;
+      r.from     = from;
+      r.to       = to;
+      r.quantity = quantity;
+      r.kind     = kind;
+   };
+   auto itr = log.find( slot );
+   if( itr == log.end() )
+      log.emplace( get_self(), write );
+   else
+      log.modify( itr, same_payer, write );
+
+   ++state.next_seq;
 }
 
-void token::tico(const asset& quantity){
-    require_auth( get_self() );
-    const name & to = name(ico_wallet);
-    auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
+void token::flush_activity()
+{
+   if( activity_pending )
+      activity_cursor( get_self(), get_self().value ).set( *activity_pending, get_self() );
+}
+#endif
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
+void token::record_checkpoint( const currency_stats& st )
+{
+   uint64_t now = current_time_point().sec_since_epoch();
+   uint64_t bucket = now / checkpoint_interval;
+   supply_sample sample{ now, st.supply, st.cir_supply, st.burn_supply, st.block_supply };
+
+   supply_ring ring( get_self(), st.sym.code().raw() );
+   uint64_t slot = bucket % checkpoint_slots;
+   auto itr = ring.find( slot );
+   if( itr != ring.end() && itr->bucket == bucket )
+      return;
+   auto write = [&]( auto& c ) {
+      c.slot   = slot;
+      c.bucket = bucket;
+      c.sample = sample;
+   };
+   if( itr == ring.end() )
+      ring.emplace( get_self(), write );
+   else
+      ring.modify( itr, same_payer, write );
+
+   supply_daily daily( get_self(), st.sym.code().raw() );
+   uint64_t day = now / checkpoint_daily_interval;
+   if( daily.find( day ) == daily.end() ) {
+      daily.emplace( get_self(), [&]( auto& c ) {
+         c.bucket = day;
+         c.sample = sample;
+      });
+   }
+}
 
-    check( quantity.symbol == st.max_ico_supply.symbol, "symbol precision mismatch" );
-    check( st.max_ico_supply.amount >= st.ico_supply.amount, "All ICO Tokens are transferred" );
-    check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_ico_supply.amount - st.ico_supply.amount, "quantity exceeds available ICO supply");
+int64_t token::sync_holder( holders& holdertable, const name& owner, int64_t balance, const name& ram_payer )
+{
+   auto itr = holdertable.find( owner.value );
+   if( itr != holdertable.end() && balance > 0 ) {
+      if( itr->balance != balance ) {
+         holdertable.modify( itr, same_payer, [&]( auto& h ) {
+            h.balance = balance;
+         });
+      }
+      return 0;
+   }
+   if( itr == holdertable.end() && balance == 0 )
+      return 0;
 
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.ico_supply += quantity;
-       s.supply += quantity;
-       s.cir_supply +=quantity;
-       });
+   if( itr == holdertable.end() ) {
+      holdertable.emplace( ram_payer, [&]( auto& h ) {
+         h.owner   = owner;
+         h.balance = balance;
+      });
+      return 1;
+   }
+   holdertable.erase( itr );
+   return -1;
+}
 
-       add_balance( to, quantity, get_self() );
+void token::add_holders( const symbol_code& sym_code, int64_t delta )
+{
+   holder_counter counter( get_self(), sym_code.raw() );
+   auto count = counter.get_or_default();
+   count.holders += delta;
+   counter.set( count, get_self() );
+}
 
+void token::update_holder( const name& owner, const asset& balance, const name& ram_payer )
+{
+   holders holdertable( get_self(), balance.symbol.code().raw() );
+   int64_t delta = sync_holder( holdertable, owner, balance.amount, ram_payer );
+   if( delta != 0 )
+      add_holders( balance.symbol.code(), delta );
 }
 
-void token::tpreico(const asset& quantity){
+void token::addholders( const symbol_code& sym_code, const std::vector<name>& owners )
+{
     require_auth( get_self() );
-    const name & to = name(ico_wallet);
-    auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
-
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
-
-    check( quantity.symbol == st.max_pre_ico_supply.symbol, "symbol precision mismatch" );
-    check( st.max_pre_ico_supply.amount >= st.pre_ico_supply.amount, "All Pre-ICO Tokens are transferred" );
-    check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_pre_ico_supply.amount - st.pre_ico_supply.amount, "quantity exceeds available Pre-ICO supply");
-
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.pre_ico_supply += quantity;
-       s.supply += quantity;
-       s.cir_supply +=quantity;
-       });
-
-       add_balance( to, quantity, get_self() );
-
+    check( !owners.empty() && owners.size() <= max_holder_backfill, "number of owners out of range" );
+
+    symbols symtable( get_self(), get_self().value );
+    symtable.get( sym_code.raw(), "token with symbol does not exist" );
+
+    holders holdertable( get_self(), sym_code.raw() );
+    int64_t delta = 0;
+    for( const auto& owner : owners ) {
+       accounts acnts( get_self(), owner.value );
+       auto ac = acnts.find( sym_code.raw() );
+       delta += sync_holder( holdertable, owner, ac == acnts.end() ? 0 : ac->balance.amount, get_self() );
+    }
+    if( delta != 0 )
+       add_holders( sym_code, delta );
 }
 
-void token::thsh(const asset& quantity){
-    require_auth( get_self() );
-    const name & to = name(history_s_h_wallet);
-     auto sym = quantity.symbol;
+void token::mint_tranche( tranches& tranchetable, const tranche_info& tr, const asset& quantity )
+{
+    auto sym = quantity.symbol;
     check( sym.is_valid(), "invalid symbol name" );
-
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
     check( quantity.is_valid(), "invalid quantity" );
     check( quantity.amount > 0, "must issue positive quantity" );
 
-    check( quantity.symbol == st.max_ico_supply.symbol, "symbol precision mismatch" );
-    check( st.max_history_s_h_supply.amount >= st.history_s_h_supply.amount, "All Amazing History ShareHolder Tokens are transferred" );
-    check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_history_s_h_supply.amount - st.history_s_h_supply.amount, "quantity exceeds available Amazing History ShareHolder supply");
-    uint64_t currentTime = current_time_point().sec_since_epoch();
-    check( currentTime>=st.lock_time_history_sh, "Lock time not finished for Amazing History ShareHolder");
-
-    //de
+    stats statstable( get_self(), sym.code().raw() );
+    const auto& st = statstable.get( sym.code().raw(), "token with symbol does not exist, create token before transfer" );
+    check( quantity.symbol == st.sym, "symbol precision mismatch" );
+    auto totals = st.totals();
+    check_rule( token_rules::check_issue( totals, tr.max_supply, tr.supply, quantity.amount ) );
+    token_rules::apply_issue( totals, quantity.amount );
+
+    tranchetable.modify( tr, same_payer, [&]( auto& t ) {
+       t.supply += quantity.amount;
+       t.last_time = current_time_point().sec_since_epoch();
+    });
     statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.history_s_h_supply += quantity;
-     s.supply += quantity;
-     s.cir_supply +=quantity;
-           });
-
-       add_balance( to, quantity, get_self() );
+       s.set_totals( totals );
+    });
+    record_checkpoint( st );
+}
 
+void token::issue_tranche( tranches& tranchetable, const tranche_info& tr, const name& to, const asset& quantity, const name& ram_payer )
+{
+    mint_tranche( tranchetable, tr, quantity );
+    add_balance( to, quantity, ram_payer );
+    log_activity( issue_activity, tr.id, to, quantity );
 }
 
- void token::tinb(const asset&   quantity){
+void token::release( const name& tranche_id, const asset& quantity )
+{
     require_auth( get_self() );
-    const name & to = name(inb_wallet);
-     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
+    tranches tranchetable( get_self(), quantity.symbol.code().raw() );
+    const auto& tr = tranchetable.get( tranche_id.value, "tranche does not exist" );
+    check( tr.wallet != name(), "tranche has no wallet to release into" );
+    check( !tr.is_vesting(), "tranche vests linearly, use claim" );
 
-    check( quantity.symbol == st.inb_supply.symbol, "symbol precision mismatch" );
-    check( st.max_inb_supply.amount > st.inb_supply.amount, "All INB Tokens are transferred" );
-    check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_inb_supply.amount - st.inb_supply.amount, "quantity exceeds available INB supply");
     uint64_t currentTime = current_time_point().sec_since_epoch();
-    check( currentTime-st.last_time_inb>=st.lock_time_inb, "Lock time not finished for INB");
+    check( currentTime >= tr.unlock_time, "Lock time not finished for tranche" );
+    check( currentTime - tr.last_time >= tr.lock_time, "Lock time not finished for tranche" );
 
-    //decrease supply
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.inb_supply +=quantity;
-       s.last_time_inb = currentTime;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
-          });
-       add_balance( to, quantity, get_self() );
+    issue_tranche( tranchetable, tr, tr.wallet, quantity, get_self() );
 }
 
-void token::tstakebonus(const name& to,const asset& quantity){
+void token::schedule( const name& tranche_id, const asset& quantity, uint64_t due )
+{
     require_auth( get_self() );
-    auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
-
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
-    const auto& st = *existing;
     check( quantity.is_valid(), "invalid quantity" );
     check( quantity.amount > 0, "must issue positive quantity" );
 
-
-    check( quantity.symbol == st.staking_supply.symbol, "symbol precision mismatch" );
-    check( st.max_staking_supply.amount >= st.staking_supply.amount, "All Staking Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_staking_supply.amount - st.staking_supply.amount, "quantity exceeds available staking supply");
-
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.staking_supply += quantity;
-  s.supply += quantity;
-        s.cir_supply +=quantity;
-        });
-
-       add_balance( to, quantity, get_self() );
-
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( quantity.symbol.code().raw(), "token with symbol does not exist" );
+    check( quantity.symbol == ts.sym, "symbol precision mismatch" );
+
+    tranches tranchetable( get_self(), quantity.symbol.code().raw() );
+    const auto& tr = tranchetable.get( tranche_id.value, "tranche does not exist" );
+    check( tr.wallet != name(), "tranche has no wallet to release into" );
+    check( !tr.is_vesting(), "tranche vests linearly, use claim" );
+    check( due >= tr.unlock_time, "Lock time not finished for tranche" );
+
+    releases schedtable( get_self(), get_self().value );
+    schedtable.emplace( get_self(), [&]( auto& r ) {
+       r.id       = schedtable.available_primary_key();
+       r.due      = due;
+       r.tranche  = tranche_id;
+       r.quantity = quantity;
+    });
 }
 
-
-void token::thnls(const asset& quantity){
+void token::unschedule( uint64_t id )
+{
     require_auth( get_self() );
-    const name & to = name(history_n_l_s_wallet);
-     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
-
-    check( quantity.symbol == st.max_history_n_l_s_supply.symbol, "symbol precision mismatch" );
-    check( st.max_history_n_l_s_supply.amount >= st.history_n_l_s_supply.amount, "All History NewsLetter Subscribers Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_history_n_l_s_supply.amount - st.history_n_l_s_supply.amount, "quantity exceeds available History NewsLetter Subscribers Tokens supply");
+    releases schedtable( get_self(), get_self().value );
+    const auto& r = schedtable.get( id, "scheduled release does not exist" );
+    schedtable.erase( r );
+}
 
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.history_n_l_s_supply += quantity;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
+void token::crank( uint32_t max_items )
+{
+    check( max_items > 0 && max_items <= max_crank_items, "max_items out of range" );
+
+    releases schedtable( get_self(), get_self().value );
+    auto bydue = schedtable.get_index<"bydue"_n>();
+    uint64_t now = current_time_point().sec_since_epoch();
+
+    uint32_t processed = 0;
+    auto itr = bydue.begin();
+    while( itr != bydue.end() && itr->due <= now && processed < max_items ) {
+       ++processed;
+       tranches tranchetable( get_self(), itr->quantity.symbol.code().raw() );
+       auto tr = tranchetable.find( itr->tranche.value );
+       bool payable = tr != tranchetable.end() && tr->wallet != name() && !tr->is_vesting();
+       // An entry whose tranche is still inside its lock window, which release would refuse, is
+       // moved to the time the window opens so it leaves the head of the queue.
+       if( payable && ( now < tr->unlock_time || now - tr->last_time < tr->lock_time ) ) {
+          uint64_t opens = std::max( tr->unlock_time, tr->last_time + tr->lock_time );
+          auto next = itr;
+          ++next;
+          bydue.modify( itr, same_payer, [&]( auto& r ) {
+             r.due = opens;
           });
-       add_balance( to, quantity, get_self() );
-
-
+          itr = next;
+          continue;
+       }
+       // An entry that can no longer be paid in full is paid what is left, so the queue never jams.
+       if( payable ) {
+          int64_t amount = std::min( itr->quantity.amount, tr->max_supply - tr->supply );
+          if( amount > 0 )
+             issue_tranche( tranchetable, *tr, tr->wallet, asset( amount, itr->quantity.symbol ), get_self() );
+       }
+       itr = bydue.erase( itr );
+    }
+    check( processed > 0, "no scheduled release is due" );
 }
 
- void token::tddsfund(const asset&   quantity){
-      require_auth( get_self() );
-      const name & to = name(ddsfundation_wallet);
-     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
+void token::tstakebonus( const name& to, const asset& quantity )
+{
+    require_auth( get_self() );
+    check( is_account( to ), "to account does not exist");
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
+    tranches tranchetable( get_self(), quantity.symbol.code().raw() );
+    const auto& tr = tranchetable.get( "staking"_n.value, "tranche does not exist" );
 
-    check( quantity.symbol == st.ddsfundation_supply.symbol, "symbol precision mismatch" );
-    check( st.max_ddsfundation_supply.amount > st.ddsfundation_supply.amount, "All Philanthropy Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_ddsfundation_supply.amount - st.ddsfundation_supply.amount, "quantity exceeds available Philanthropy Tokens supply");
-    uint64_t currentTime = current_time_point().sec_since_epoch();
-    check( currentTime-st.last_time_ddsfundation>=st.lock_time_ddsfundation, "Lock time not finished for Philanthropy");
+    issue_tranche( tranchetable, tr, to, quantity, get_self() );
+}
 
-    //decrease supply
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.ddsfundation_supply +=quantity;
-       s.last_time_ddsfundation = currentTime;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
-          });
-        add_balance( to, quantity, get_self() );
+void token::tstakebatch( const std::vector<std::pair<name, uint64_t>>& stakers, const asset& total )
+{
+    require_auth( get_self() );
+    check( !stakers.empty(), "no stakers provided" );
+
+    uint64_t total_weight = 0;
+    for( const auto& s : stakers ) {
+        check( s.second > 0, "staker weight must be positive" );
+        check( s.second <= std::numeric_limits<uint64_t>::max() - total_weight, "total staker weight overflow" );
+        check( is_account( s.first ), "to account does not exist");
+        total_weight += s.second;
+    }
+
+    tranches tranchetable( get_self(), total.symbol.code().raw() );
+    const auto& tr = tranchetable.get( "staking"_n.value, "tranche does not exist" );
+    mint_tranche( tranchetable, tr, total );
+
+    uint64_t cumulative_weight = 0;
+    int64_t  paid = 0;
+    for( const auto& s : stakers ) {
+        cumulative_weight += s.second;
+        int64_t upto = token_rules::cumulative_share( total.amount, cumulative_weight, total_weight );
+        int64_t share = upto - paid;
+        paid = upto;
+        if( share > 0 ) {
+           add_balance( s.first, asset( share, total.symbol ), get_self() );
+           log_activity( issue_activity, tr.id, s.first, asset( share, total.symbol ) );
+        }
+    }
 }
 
- void token::tmarketad(const asset&   quantity){
- require_auth( get_self() );
-   const name & to = name(market_ad_wallet);
-     auto sym = quantity.symbol;
+void token::settranche( const name&   tranche_id,
+                        const name&   wallet,
+                        const asset&  max_supply,
+                        uint64_t      unlock_time,
+                        uint64_t      lock_time )
+{
+    require_auth( get_self() );
+
+    auto sym = max_supply.symbol;
     check( sym.is_valid(), "invalid symbol name" );
+    check( max_supply.is_valid(), "invalid supply");
+    check( max_supply.amount >= 0, "max-supply must not be negative");
+    check( wallet == name() || is_account( wallet ), "wallet account does not exist");
 
     stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
-
-    check( quantity.symbol == st.market_ad_supply.symbol, "symbol precision mismatch" );
-    check( st.max_market_ad_supply.amount > st.market_ad_supply.amount, "All Marketing Ads Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_market_ad_supply.amount - st.market_ad_supply.amount, "quantity exceeds available Marketing Ads Tokens supply");
-    uint64_t currentTime = current_time_point().sec_since_epoch();
-    check( currentTime-st.last_time_market_ad>=st.lock_time_market_ad, "Lock time not finished for Marketing Ads Tokens");
-
-    //decrease supply
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.market_ad_supply +=quantity;
-       s.last_time_market_ad = currentTime;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
-          });
-        add_balance( to, quantity, get_self() );
+    const auto& st = statstable.get( sym.code().raw(), "token with symbol does not exist" );
+    check( sym == st.sym, "symbol precision mismatch" );
+
+    tranches tranchetable( get_self(), sym.code().raw() );
+    int64_t allocated = max_supply.amount;
+    for( const auto& t : tranchetable ) {
+       if( t.id != tranche_id )
+          allocated += t.max_supply;
+    }
+    check( allocated <= st.max_supply, "max-supply must be greater than allocated transfers summation" );
+
+    auto existing = tranchetable.find( tranche_id.value );
+    if( existing == tranchetable.end() ) {
+       tranchetable.emplace( get_self(), [&]( auto& t ) {
+          t.id          = tranche_id;
+          t.wallet      = wallet;
+          t.max_supply  = max_supply.amount;
+          t.unlock_time = unlock_time;
+          t.lock_time   = lock_time;
+       });
+    } else {
+       check( max_supply.amount >= existing->supply, "max-supply is lower than the released tranche supply" );
+       tranchetable.modify( existing, same_payer, [&]( auto& t ) {
+          t.wallet      = wallet;
+          t.max_supply  = max_supply.amount;
+          t.unlock_time = unlock_time;
+          t.lock_time   = lock_time;
+       });
+    }
 }
 
- void token::tmanteam(const asset&   quantity){
- require_auth( get_self() );
-   const name & to = name(man_team_wallet);
-     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
+void token::setvesting( const name&         tranche_id,
+                        const symbol_code&  sym_code,
+                        uint64_t            start,
+                        uint64_t            cliff,
+                        uint64_t            duration )
+{
+    require_auth( get_self() );
+    check( cliff <= duration, "cliff must not exceed vesting duration" );
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
+    check( start <= std::numeric_limits<uint64_t>::max() - duration, "vesting end overflow" );
 
-    check( quantity.symbol == st.man_team_supply.symbol, "symbol precision mismatch" );
-    check( st.max_man_team_supply.amount > st.man_team_supply.amount, "All Management Team Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_man_team_supply.amount - st.man_team_supply.amount, "quantity exceeds available Management Team Tokens supply");
-    uint64_t currentTime = current_time_point().sec_since_epoch();
-    check( currentTime-st.last_time_man_team>=st.lock_time_man_team, "Lock time not finished for Management Team Tokens");
+    tranches tranchetable( get_self(), sym_code.raw() );
+    const auto& tr = tranchetable.get( tranche_id.value, "tranche does not exist" );
+    check( tr.wallet != name(), "tranche has no wallet to vest into" );
+    check( start >= tr.unlock_time, "vesting must not start before the tranche unlock time" );
 
-    //decrease supply
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.man_team_supply +=quantity;
-       s.last_time_man_team = currentTime;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
-          });
-       add_balance( to, quantity, get_self() );
+    tranchetable.modify( tr, same_payer, [&]( auto& t ) {
+       t.vest_start    = start;
+       t.vest_cliff    = cliff;
+       t.vest_duration = duration;
+    });
 }
 
-void token::toperatecost(const asset& quantity){
-require_auth( get_self() );
-   const name & to = name(opt_cost_wallet);
-     auto sym = quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
-
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
-
+void token::claim( const name& tranche_id, const symbol_code& sym_code )
+{
+    symbols symtable( get_self(), get_self().value );
+    const auto& ts = symtable.get( sym_code.raw(), "token with symbol does not exist" );
 
-    check( quantity.symbol == st.max_opt_cost_supply.symbol, "symbol precision mismatch" );
-    check( st.max_opt_cost_supply.amount >= st.opt_cost_supply.amount, "All Operating Cost Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_opt_cost_supply.amount - st.opt_cost_supply.amount, "quantity exceeds available Operating Cost Tokens supply");
+    tranches tranchetable( get_self(), sym_code.raw() );
+    const auto& tr = tranchetable.get( tranche_id.value, "tranche does not exist" );
+    check( tr.is_vesting(), "tranche does not vest, use release" );
+    check( tr.wallet != name(), "tranche has no wallet to vest into" );
 
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.opt_cost_supply += quantity;
-   s.supply += quantity;
-         s.cir_supply +=quantity;
-         });
-      add_balance( to, quantity, get_self() );
+    uint64_t now = current_time_point().sec_since_epoch();
+    check( now >= tr.unlock_time, "Lock time not finished for tranche" );
+    int64_t claimable = tr.vested( now ) - tr.supply;
+    check( claimable > 0, "nothing vested to claim" );
 
+    issue_tranche( tranchetable, tr, tr.wallet, asset( claimable, ts.sym ), get_self() );
 }
 
-void token::thsf(const asset& quantity){
-require_auth( get_self() );
-    const name & to = name(history_s_f_wallet);
-     auto sym = quantity.symbol;
+void token::setdrop( uint64_t round, const checksum256& root, const asset& total )
+{
+    require_auth( get_self() );
+
+    auto sym = total.symbol;
     check( sym.is_valid(), "invalid symbol name" );
+    check( total.is_valid(), "invalid quantity" );
+    check( total.amount > 0, "airdrop total must be positive" );
+
+    tranches tranchetable( get_self(), sym.code().raw() );
+    const auto& tr = tranchetable.get( "airdrop"_n.value, "tranche does not exist" );
+    check( total.amount <= tr.max_supply - tr.supply, "quantity exceeds available tranche supply" );
+
+    droprounds rounds( get_self(), get_self().value );
+    check( rounds.find( round ) == rounds.end(), "airdrop round already exists" );
+    rounds.emplace( get_self(), [&]( auto& r ) {
+       r.id      = round;
+       r.root    = root;
+       r.total   = total;
+       r.claimed = asset( 0, sym );
+    });
+}
 
-    stats statstable( get_self(), sym.code().raw() );
-    auto existing = statstable.find( sym.code().raw() );
-    check( existing != statstable.end(), "token with symbol does not exist, create token before transfer" );
-    const auto& st = *existing;
-    check( quantity.is_valid(), "invalid quantity" );
-    check( quantity.amount > 0, "must issue positive quantity" );
+void token::claimdrop( uint64_t                         round,
+                       const name&                      account,
+                       uint64_t                         index,
+                       const asset&                     amount,
+                       const std::vector<checksum256>&  proof )
+{
+    require_auth( account );
+
+    droprounds rounds( get_self(), get_self().value );
+    const auto& rd = rounds.get( round, "airdrop round does not exist" );
+    check( amount.symbol == rd.total.symbol, "symbol precision mismatch" );
+    check( amount.amount > 0, "must claim positive quantity" );
+    check( amount.amount <= rd.total.amount - rd.claimed.amount, "quantity exceeds remaining airdrop round supply" );
+    check( proof.size() < 64 && ( index >> proof.size() ) == 0, "leaf index out of range of the proof" );
+
+    auto node = hash_drop_leaf( index, account, amount.amount );
+    for( size_t level = 0; level < proof.size(); ++level ) {
+        node = ( ( index >> level ) & 1 ) ? hash_pair( proof[level], node ) : hash_pair( node, proof[level] );
+    }
+    check( node == rd.root, "invalid merkle proof" );
+
+    dropclaims claims( get_self(), round );
+    uint64_t bucket = index / 64;
+    uint64_t bit = uint64_t(1) << ( index % 64 );
+    auto itr = claims.find( bucket );
+    if( itr == claims.end() ) {
+       claims.emplace( account, [&]( auto& c ) {
+          c.bucket = bucket;
+          c.bits   = bit;
+       });
+    } else {
+       check( ( itr->bits & bit ) == 0, "airdrop already claimed" );
+       claims.modify( itr, same_payer, [&]( auto& c ) {
+          c.bits |= bit;
+       });
+    }
 
+    rounds.modify( rd, same_payer, [&]( auto& r ) {
+       r.claimed += amount;
+    });
 
-    check( quantity.symbol == st.max_history_s_f_supply.symbol, "symbol precision mismatch" );
-    check( st.max_history_s_f_supply.amount >= st.history_s_f_supply.amount, "All Amazing Subscribers and Followers Tokens are transferred" );
-        check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
-    check( quantity.amount <= st.max_history_s_f_supply.amount - st.history_s_f_supply.amount, "quantity exceeds available Subscribers and Followers Tokens supply");
+    tranches tranchetable( get_self(), amount.symbol.code().raw() );
+    const auto& tr = tranchetable.get( "airdrop"_n.value, "tranche does not exist" );
+    issue_tranche( tranchetable, tr, account, amount, account );
+}
 
-    statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.history_s_f_supply += quantity;
-    s.supply += quantity;
-          s.cir_supply +=quantity;
-          });
+void token::audit( const symbol_code& sym_code, uint32_t max_scopes )
+{
+    check( max_scopes > 0 && max_scopes <= max_audit_scopes, "max_scopes out of range" );
+
+    audit_cursor cursor( get_self(), sym_code.raw() );
+    auto state = cursor.get_or_default();
+
+    holders holdertable( get_self(), sym_code.raw() );
+    auto itr = holdertable.lower_bound( state.cursor.value );
+    for( uint32_t scanned = 0; scanned < max_scopes && itr != holdertable.end(); ++scanned, ++itr ) {
+       accounts acnts( get_self(), itr->owner.value );
+       auto ac = acnts.find( sym_code.raw() );
+       int64_t balance = ac == acnts.end() ? 0 : ac->balance.amount;
+       if( balance != itr->balance )
+          ++state.registry_mismatches;
+       state.balance_total += balance;
+       ++state.scanned;
+    }
+
+    if( itr != holdertable.end() ) {
+       state.cursor = itr->owner;
+       cursor.set( state, get_self() );
+       return;
+    }
+
+    // End of pass, compare the totals gathered so far with the stat and tranche rows.
+    stats statstable( get_self(), sym_code.raw() );
+    const auto& st = statstable.get( sym_code.raw(), "token with symbol does not exist" );
+    tranches tranchetable( get_self(), sym_code.raw() );
+    int64_t tranche_total = 0;
+    for( const auto& t : tranchetable )
+       tranche_total += t.supply;
+
+    state.last_pass = { current_time_point().sec_since_epoch(),
+                        state.scanned,
+                        state.registry_mismatches,
+                        state.balance_total,
+                        st.cir_supply,
+                        tranche_total,
+                        st.supply };
+    ++state.passes;
+    state.cursor = name();
+    state.scanned = 0;
+    state.registry_mismatches = 0;
+    state.balance_total = 0;
+    cursor.set( state, get_self() );
+}
 
-     add_balance( to, quantity, get_self() );
+supply_summary token::getsupply( const symbol_code& sym_code )
+{
+    stats statstable( get_self(), sym_code.raw() );
+    const auto& st = statstable.get( sym_code.raw(), "token with symbol does not exist" );
+    holder_counter counter( get_self(), sym_code.raw() );
+
+    supply_summary summary{
+       st.as_asset( st.supply ),
+       st.as_asset( st.max_supply ),
+       st.as_asset( st.cir_supply ),
+       st.as_asset( st.burn_supply ),
+       st.as_asset( st.block_supply ),
+       st.as_asset( st.available_supply ),
+       counter.get_or_default().holders,
+       {}
+    };
+
+    tranches tranchetable( get_self(), sym_code.raw() );
+    for( const auto& t : tranchetable ) {
+       summary.tranches.push_back( { t.id, st.as_asset( t.max_supply - t.supply ) } );
+    }
+    return summary;
 }
 
 void token::block(const asset&   quantity)
@@ -531,14 +1084,17 @@ void token::block(const asset&   quantity)
     check( existingstat != statstable.end(), "token with symbol does not exist, create token before blocking it" );
     const auto& st = *existingstat;
     require_auth( st.issuer );
-    check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
-    check( quantity.amount <= st.cir_supply.amount, "quantity exceeds available circulating supply");
+    check( quantity.symbol == st.sym, "symbol precision mismatch" );
+    auto totals = st.totals();
+    check_rule( token_rules::check_retire( totals, quantity.amount ) );
+    token_rules::apply_block( totals, quantity.amount );
 //decrease supply
     statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.cir_supply -= quantity;
-       s.block_supply += quantity;
+       s.set_totals( totals );
     });
+    record_checkpoint( st );
     sub_balance( st.issuer, quantity );
+    log_activity( block_activity, st.issuer, name(), quantity );
 }
 void token::unblock(const asset& quantity)
 {
@@ -552,13 +1108,16 @@ void token::unblock(const asset& quantity)
     check( existingstat != statstable.end(), "token with symbol does not exist, create and block the token before un-blocking it" );
     const auto& st = *existingstat;
     require_auth( st.issuer );
-    check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
-    check( quantity.amount <= st.block_supply.amount, "quantity exceeds available blocked token");
+    check( quantity.symbol == st.sym, "symbol precision mismatch" );
+    auto totals = st.totals();
+    check_rule( token_rules::check_unblock( totals, quantity.amount ) );
+    token_rules::apply_unblock( totals, quantity.amount );
    //decrease supply
     statstable.modify( st, same_payer, [&]( auto& s ) {
-       s.cir_supply += quantity;
-       s.block_supply -= quantity;
+       s.set_totals( totals );
     });
+    record_checkpoint( st );
       add_balance( st.issuer, quantity, st.issuer );
+      log_activity( unblock_activity, name(), st.issuer, quantity );
 }
 }/// namespace eosio
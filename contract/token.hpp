@@ -1,9 +1,35 @@
 #pragma once
 
 #include <eosio/asset.hpp>
+#include <eosio/crypto.hpp>
 #include <eosio/eosio.hpp>
+#include <eosio/singleton.hpp>
 #include <eosio/system.hpp>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
 #include <string>
+#include <vector>
+
+#include "token_metrics.hpp"
+#include "token_rules.hpp"
+
+#ifndef TOKEN_CHECKPOINT_INTERVAL
+#define TOKEN_CHECKPOINT_INTERVAL 3600
+#endif
+#ifndef TOKEN_CHECKPOINT_SLOTS
+#define TOKEN_CHECKPOINT_SLOTS 720
+#endif
+#ifndef TOKEN_CHECKPOINT_DAILY_INTERVAL
+#define TOKEN_CHECKPOINT_DAILY_INTERVAL 86400
+#endif
+
+#ifdef TOKEN_ACTIVITY_LOG
+#ifndef TOKEN_ACTIVITY_LOG_SIZE
+#define TOKEN_ACTIVITY_LOG_SIZE 1024
+#endif
+#endif
 
 namespace eosiosystem {
    class system_contract;
@@ -13,6 +39,28 @@ namespace eosio {
 
    using std::string;
 
+   /**
+    * Remaining headroom of one allocation tranche, part of `supply_summary`.
+    */
+   struct tranche_headroom {
+      name     id;
+      asset    remaining;
+   };
+
+   /**
+    * Aggregated supply figures of a token, returned by the `getsupply` action.
+    */
+   struct supply_summary {
+      asset                          supply;
+      asset                          max_supply;
+      asset                          circulating;
+      asset                          burned;
+      asset                          blocked;
+      asset                          available;
+      uint64_t                       holders;
+      std::vector<tranche_headroom>  tranches;
+   };
+
    /**
     * eosio.token contract defines the structures and actions that allow users to create, issue, and manage
     * tokens on eosio based blockchains.
@@ -21,6 +69,17 @@ namespace eosio {
       public:
          using contract::contract;
 
+#if defined( TOKEN_METRICS ) || defined( TOKEN_ACTIVITY_LOG )
+         ~token() {
+#ifdef TOKEN_ACTIVITY_LOG
+            flush_activity();
+#endif
+#ifdef TOKEN_METRICS
+            print_token_metrics();
+#endif
+         }
+#endif
+
          /**
           * Allows `issuer` account to create a token in supply of `maximum_supply`. If validation is successful a new entry in statstable for token symbol scope gets created.
           *
@@ -35,6 +94,18 @@ namespace eosio {
          [[eosio::action]]
          void create( const name&   issuer,
                       const asset&  maximum_supply);
+
+         /**
+          * Converts the `stat` row of a token created before the compact layout into a
+          * `tokenstats` row plus one `tranches` row per allocation tranche, then erases the old
+          * row. Tokens created by an earlier deployment cannot be used until this has run.
+          *
+          * @param sym_code - the token symbol code to convert.
+          *
+          * @pre The token must still have its `stat` row.
+          */
+         [[eosio::action]]
+         void convertstat( const symbol_code& sym_code );
          /**
           * The opposite for create action, if all validations succeed,
           * it debits the statstable.supply amount.
@@ -59,6 +130,53 @@ namespace eosio {
                         const name&    to,
                         const asset&   quantity,
                         const string&  memo );
+
+         /**
+          * Compact form of `transfer` for deployments holding a single token: the symbol is implied,
+          * there is no memo and `from`/`to` are only notified when `notify` is set. Wallets and
+          * exchanges watching for `transfer` notifications will not see un-notified moves.
+          *
+          * @param from - the account to transfer from,
+          * @param to - the account to be transferred to,
+          * @param amount - the amount of tokens to be transferred, in the smallest unit of the token,
+          * @param notify - whether to notify `from` and `to`.
+          */
+         [[eosio::action]]
+         void xfer( const name&    from,
+                    const name&    to,
+                    int64_t        amount,
+                    bool           notify );
+
+         /**
+          * Settles a batch of trades of the deployment's single token by applying each account's net
+          * delta once. Negative deltas debit an account and require its authorization, positive
+          * deltas credit it. The first debited account pays for new balance rows of credited
+          * accounts that did not authorize the action. Every account is notified.
+          *
+          * @param deltas - the list of (account, net amount) pairs, in the smallest unit of the token.
+          *
+          * @pre Accounts must be sorted by name and appear once,
+          * @pre Deltas must be non-zero and sum to zero.
+          */
+         [[eosio::action]]
+         void settle( const std::vector<std::pair<name, int64_t>>& deltas );
+
+         /**
+          * Allows `from` account to pay out to many accounts in a single action.
+          * The token symbol is validated once, `from` is debited once for the sum of all
+          * quantities and each recipient is credited with its own quantity.
+          *
+          * @param from - the account to transfer from,
+          * @param transfers - the list of (recipient, quantity) pairs to be credited,
+          * @param memo - the memo string to accompany the transaction.
+          *
+          * @pre All quantities must be positive and share the same symbol,
+          * @pre `from` must not appear as a recipient and every recipient account must exist.
+          */
+         [[eosio::action]]
+         void transferbatch( const name&                                from,
+                             const std::vector<std::pair<name, asset>>& transfers,
+                             const string&                              memo );
   /**
           * This action is to transfer ICO token
           *
@@ -76,51 +194,292 @@ namespace eosio {
          [[eosio::action]]
             void unblock(const asset&   quantity);
 
-        [[eosio::action]]
-         void tairdrop(const asset& quantity);
+         /**
+          * Locks `quantity` tokens on account `to` until `unlock_time`. Locked tokens stay in the
+          * balance of `to` but cannot be spent before they unlock; expired locks are dropped lazily
+          * the first time `to` spends. When `from` differs from `to` the tokens are transferred
+          * from `from` to `to` first.
+          *
+          * @param from - the account locking the tokens, it pays for the lock row,
+          * @param to - the account whose tokens get locked,
+          * @param quantity - the quantity of tokens to lock,
+          * @param unlock_time - the time the tokens unlock, in seconds since epoch.
+          *
+          * @pre Locking on another account requires its authorization unless `from` is the token issuer,
+          * @pre An account can hold at most `max_locks` unexpired locks, expired ones are dropped first.
+          */
+         [[eosio::action]]
+         void lock( const name&    from,
+                    const name&    to,
+                    const asset&   quantity,
+                    uint64_t       unlock_time );
 
-          [[eosio::action]]
-         void tico(const asset& quantity);
+         /**
+          * Streams `rate` tokens per second from `payer` to `payee` between `start` and `stop`.
+          * The whole deposit, `rate` times the stream duration, is escrowed in the balance of the
+          * contract account when the stream is created and only streams can pay it out; nothing
+          * moves while a stream runs. The accrued
+          * amount is computed when the payee withdraws or either party cancels.
+          *
+          * @param payer - the account funding the stream, it pays for the stream row,
+          * @param payee - the account receiving the stream,
+          * @param rate - the quantity of tokens streamed per second,
+          * @param start - the time the stream starts accruing, in seconds since epoch,
+          * @param stop - the time the stream stops accruing, in seconds since epoch.
+          */
+         [[eosio::action]]
+         void createstream( const name&    payer,
+                            const name&    payee,
+                            const asset&   rate,
+                            uint64_t       start,
+                            uint64_t       stop );
 
-          [[eosio::action]]
-         void tpreico(const asset& quantity);
+         /**
+          * Pays the payee of stream `id` everything accrued and not yet withdrawn. The stream row
+          * is erased once its whole deposit has been withdrawn.
+          *
+          * @param id - the stream to withdraw from.
+          */
+         [[eosio::action]]
+         void withdraw( uint64_t id );
 
-           [[eosio::action]]
-          void thsh(const asset& quantity);
+         /**
+          * Ends stream `id`: the payee receives what has accrued and the payer is refunded the rest
+          * of the deposit. Either party may cancel.
+          *
+          * @param id - the stream to cancel,
+          * @param canceller - the payer or payee of the stream, it pays for any balance row created.
+          */
+         [[eosio::action]]
+         void cancelstream( uint64_t id, const name& canceller );
 
+         /**
+          * Allows `ram_payer` to create an account `owner` with zero balance for
+          * token `symbol` at the expense of `ram_payer`.
+          *
+          * @param owner - the account to be created,
+          * @param symbol - the token to be payed with by `ram_payer`,
+          * @param ram_payer - the account that supports the cost of this action.
+          */
+         [[eosio::action]]
+         void open( const name& owner, const symbol& symbol, const name& ram_payer );
 
+         /**
+          * This action is the opposite for open, it closes the account `owner`
+          * for token `symbol` and frees the RAM of its balance row.
+          *
+          * @param owner - the owner account to execute the close action for,
+          * @param symbol - the symbol of the token to execute the close action for.
+          *
+          * @pre The pair of owner plus symbol has to exist otherwise no action is executed,
+          * @pre If the pair of owner plus symbol exists, the balance has to be zero.
+          *
+          * Building with `-DTOKEN_AUTO_CLOSE` makes every debit that empties a balance
+          * erase the row as well, so dust recipients do not keep RAM allocated.
+          */
          [[eosio::action]]
-         void tinb(const asset& quantity);
+         void close( const name& owner, const symbol& symbol );
 
-          [[eosio::action]]
-        void tstakebonus(const name& to,const asset& quantity);
+         /**
+          * Releases `quantity` tokens from the allocation tranche `tranche_id` into the tranche wallet.
+          * Only the tranche row and the token supply totals are updated.
+          *
+          * @param tranche_id - the tranche to release from, e.g. `ico` or `manteam`,
+          * @param quantity - the quantity of tokens to release.
+          *
+          * @pre The tranche must exist for the quantity symbol and have a wallet,
+          * @pre The tranche unlock time must have passed and, for periodic tranches,
+          *      `lock_time` seconds must have elapsed since the previous release,
+          * @pre quantity must not exceed the remaining tranche supply.
+          */
+         [[eosio::action]]
+         void release( const name& tranche_id, const asset& quantity );
 
+         /**
+          * Queues a release of `quantity` from tranche `tranche_id` into the tranche wallet at `due`.
+          * Queued releases are paid out by `crank` without further admin signatures.
+          *
+          * @param tranche_id - the tranche to release from,
+          * @param quantity - the quantity of tokens to release,
+          * @param due - the time the release becomes payable, in seconds since epoch.
+          *
+          * @pre quantity must match the token symbol and precision,
+          * @pre due must not be before the tranche unlock time.
+          */
+         [[eosio::action]]
+         void schedule( const name& tranche_id, const asset& quantity, uint64_t due );
 
-           [[eosio::action]]
-        void thnls(const asset& quantity);
+         /**
+          * Removes a queued release.
+          *
+          * @param id - the id of the queued release.
+          */
+         [[eosio::action]]
+         void unschedule( uint64_t id );
 
-          [[eosio::action]]
-         void tddsfund(const asset& quantity);
+         /**
+          * Pays out due queued releases, oldest due time first, at most `max_items` per call so the
+          * work always fits in one transaction. Anyone may push this action. A release larger than
+          * what is left in its tranche pays the remainder. Releases of a tranche still inside its
+          * unlock or `lock_time` window are moved to the time the window opens, so a periodic
+          * tranche pays one entry per window; moving an entry counts toward `max_items`.
+          *
+          * @param max_items - the maximum number of queued releases to process, at most `max_crank_items`.
+          */
+         [[eosio::action]]
+         void crank( uint32_t max_items );
 
-          [[eosio::action]]
-         void tmarketad(const asset& quantity);
+         /**
+          * Pays a staking bonus out of the `staking` tranche to `to`.
+          *
+          * @param to - the account receiving the bonus,
+          * @param quantity - the quantity of tokens to release.
+          */
+         [[eosio::action]]
+         void tstakebonus( const name& to, const asset& quantity );
+
+         /**
+          * Distributes `total` out of the `staking` tranche pro rata to `stakers` in one pass.
+          * Shares are computed with 128 bit integer math and always add up to exactly `total`.
+          * The tranche cap is checked and the supply totals are updated once for the whole batch.
+          *
+          * @param stakers - the list of (account, weight) pairs to pay,
+          * @param total - the total bonus to distribute.
+          *
+          * @pre Every weight must be positive and the weights must sum to less than 2^64.
+          */
+         [[eosio::action]]
+         void tstakebatch( const std::vector<std::pair<name, uint64_t>>& stakers, const asset& total );
+
+         /**
+          * Adds a new allocation tranche or updates an existing one.
+          *
+          * @param tranche_id - the tranche to add or update,
+          * @param wallet - the account `release` pays into, empty for tranches paid out by dedicated actions,
+          * @param max_supply - the tranche cap, its symbol selects the token,
+          * @param unlock_time - no release is allowed before this time (seconds since epoch), 0 for none,
+          * @param lock_time - minimum number of seconds between two releases, 0 for none.
+          *
+          * @pre The sum of all tranche caps must not exceed the token max supply,
+          * @pre max_supply must not be lower than what the tranche already released.
+          */
+         [[eosio::action]]
+         void settranche( const name&   tranche_id,
+                          const name&   wallet,
+                          const asset&  max_supply,
+                          uint64_t      unlock_time,
+                          uint64_t      lock_time );
+
+         /**
+          * Switches a tranche to linear vesting. Nothing vests before `start + cliff`, after that the
+          * vested amount grows linearly from `start` until the whole tranche cap is vested at
+          * `start + duration`. A duration of 0 switches the tranche back to `release`.
+          *
+          * @param tranche_id - the tranche to configure,
+          * @param sym_code - the token symbol code the tranche belongs to,
+          * @param start - vesting start time in seconds since epoch,
+          * @param cliff - seconds after `start` before anything can be claimed,
+          * @param duration - seconds after `start` at which the full cap is vested.
+          *
+          * @pre The tranche must have a wallet,
+          * @pre start must not be before the tranche unlock time,
+          * @pre cliff must not exceed duration.
+          */
+         [[eosio::action]]
+         void setvesting( const name&         tranche_id,
+                          const symbol_code&  sym_code,
+                          uint64_t            start,
+                          uint64_t            cliff,
+                          uint64_t            duration );
+
+         /**
+          * Releases everything vested so far and not yet released from a vesting tranche into the
+          * tranche wallet. Anyone may push this action, the funds can only go to the tranche wallet.
+          *
+          * @param tranche_id - the vesting tranche to claim from,
+          * @param sym_code - the token symbol code the tranche belongs to.
+          */
+         [[eosio::action]]
+         void claim( const name& tranche_id, const symbol_code& sym_code );
 
-          [[eosio::action]]
-         void tmanteam(const asset& quantity);
+         /**
+          * Publishes the Merkle root of an airdrop round. Recipients pull their allocation with
+          * `claimdrop`, so only accounts that actually claim are ever minted to.
+          *
+          * Leaves are `sha256( index || account || amount )` with each field as a little endian
+          * 64 bit integer; inner nodes are `sha256( left || right )`, the side being given by the
+          * corresponding bit of the leaf index.
+          *
+          * @param round - the airdrop round id,
+          * @param root - the Merkle root of the round,
+          * @param total - the sum of all allocations in the round.
+          *
+          * @pre The round must not exist yet,
+          * @pre total must fit in the remaining `airdrop` tranche supply.
+          */
+         [[eosio::action]]
+         void setdrop( uint64_t round, const checksum256& root, const asset& total );
 
+         /**
+          * Claims the airdrop allocation of `account` in `round` and mints it from the `airdrop`
+          * tranche. Each leaf index can be claimed once.
+          *
+          * @param round - the airdrop round id,
+          * @param account - the account the allocation belongs to, it pays for its balance row,
+          * @param index - the leaf index of the allocation,
+          * @param amount - the allocated amount,
+          * @param proof - the sibling hashes from the leaf up to the root.
+          */
+         [[eosio::action]]
+         void claimdrop( uint64_t                         round,
+                         const name&                      account,
+                         uint64_t                         index,
+                         const asset&                     amount,
+                         const std::vector<checksum256>&  proof );
 
+         /**
+          * Advances the conservation audit of token `sym_code` by up to `max_scopes` holders, resuming
+          * from the cursor stored by the previous call. Balances are read from each holder's
+          * `accounts` scope and summed; at the end of a pass the sum is recorded next to `cir_supply`,
+          * and the sum of the tranche supplies next to `supply`. Anyone may push this action.
+          *
+          * Contracts cannot enumerate table scopes, so the walk follows the `holders` registry.
+          * Balances that change while a pass is in progress can skew that pass; mismatches are
+          * recorded in the `audit` table, not enforced.
+          *
+          * @param sym_code - the token symbol code to audit,
+          * @param max_scopes - the maximum number of holders to visit, at most `max_audit_scopes`.
+          */
          [[eosio::action]]
-        void toperatecost(const asset& quantity);
+         void audit( const symbol_code& sym_code, uint32_t max_scopes );
 
-           [[eosio::action]]
-        void thsf(const asset& quantity);
+         /**
+          * Registers `owners` in the `holders` registry of token `sym_code` from their `accounts`
+          * rows, for balances that existed before the registry. Owners already registered are
+          * re-synced, owners with an empty balance are dropped. The contract pays for new rows.
+          *
+          * @param sym_code - the token symbol code to backfill,
+          * @param owners - the accounts to register, at most `max_holder_backfill`.
+          */
+         [[eosio::action]]
+         void addholders( const symbol_code& sym_code, const std::vector<name>& owners );
 
+         /**
+          * Read-only query returning the supply figures of token `sym_code` and the remaining
+          * headroom of each allocation tranche through the action return value.
+          *
+          * @param sym_code - the token symbol code to report on.
+          *
+          * @return the aggregated supply of the token.
+          */
+         [[eosio::action, eosio::read_only]]
+         supply_summary getsupply( const symbol_code& sym_code );
 
          static asset get_supply( const name& token_contract_account, const symbol_code& sym_code )
          {
             stats statstable( token_contract_account, sym_code.raw() );
             const auto& st = statstable.get( sym_code.raw() );
-            return st.supply;
+            return st.as_asset( st.supply );
          }
 
          static asset get_balance( const name& token_contract_account, const name& owner, const symbol_code& sym_code )
@@ -131,31 +490,80 @@ namespace eosio {
          }
 
          using create_action = eosio::action_wrapper<"create"_n, &token::create>;
+         using convertstat_action = eosio::action_wrapper<"convertstat"_n, &token::convertstat>;
          using burn_action = eosio::action_wrapper<"burn"_n, &token::burn>;
          using transfer_action = eosio::action_wrapper<"transfer"_n, &token::transfer>;
+         using xfer_action = eosio::action_wrapper<"xfer"_n, &token::xfer>;
+         using settle_action = eosio::action_wrapper<"settle"_n, &token::settle>;
+         using transferbatch_action = eosio::action_wrapper<"transferbatch"_n, &token::transferbatch>;
+         using audit_action = eosio::action_wrapper<"audit"_n, &token::audit>;
+         using addholders_action = eosio::action_wrapper<"addholders"_n, &token::addholders>;
+         using getsupply_action = eosio::action_wrapper<"getsupply"_n, &token::getsupply>;
+         using lock_action = eosio::action_wrapper<"lock"_n, &token::lock>;
+         using createstream_action = eosio::action_wrapper<"createstream"_n, &token::createstream>;
+         using withdraw_action = eosio::action_wrapper<"withdraw"_n, &token::withdraw>;
+         using cancelstream_action = eosio::action_wrapper<"cancelstream"_n, &token::cancelstream>;
+         using open_action = eosio::action_wrapper<"open"_n, &token::open>;
+         using close_action = eosio::action_wrapper<"close"_n, &token::close>;
          using block_action = eosio::action_wrapper<"block"_n, &token::block>;
          using unblock_action = eosio::action_wrapper<"unblock"_n, &token::unblock>;
+         using release_action = eosio::action_wrapper<"release"_n, &token::release>;
+         using schedule_action = eosio::action_wrapper<"schedule"_n, &token::schedule>;
+         using unschedule_action = eosio::action_wrapper<"unschedule"_n, &token::unschedule>;
+         using crank_action = eosio::action_wrapper<"crank"_n, &token::crank>;
          using tstakebonus_action = eosio::action_wrapper<"tstakebonus"_n, &token::tstakebonus>;
-         using tairdrop_action = eosio::action_wrapper<"tico"_n, &token::tairdrop>;
-         using tico_action = eosio::action_wrapper<"tico"_n, &token::tico>;
-         using tpreico_action = eosio::action_wrapper<"tico"_n, &token::tpreico>;
-         using thnls_action = eosio::action_wrapper<"thnls"_n, &token::thnls>;
-         using toperatecost_action = eosio::action_wrapper<"toperatecost"_n, &token::toperatecost>;
-         using thsf_action = eosio::action_wrapper<"thsf"_n, &token::thsf>;
-         using tinb_action = eosio::action_wrapper<"tinb"_n, &token::tinb>;
-         using tddsfund_action = eosio::action_wrapper<"tddsfund"_n, &token::tddsfund>;
-         using tmarketad_action = eosio::action_wrapper<"tmarketad"_n, &token::tmarketad>;
-         using tmanteam_action = eosio::action_wrapper<"tmanteam"_n, &token::tmanteam>;
-         using thsh_action = eosio::action_wrapper<"thsh"_n, &token::thsh>;
+         using tstakebatch_action = eosio::action_wrapper<"tstakebatch"_n, &token::tstakebatch>;
+         using settranche_action = eosio::action_wrapper<"settranche"_n, &token::settranche>;
+         using setvesting_action = eosio::action_wrapper<"setvesting"_n, &token::setvesting>;
+         using claim_action = eosio::action_wrapper<"claim"_n, &token::claim>;
+         using setdrop_action = eosio::action_wrapper<"setdrop"_n, &token::setdrop>;
+         using claimdrop_action = eosio::action_wrapper<"claimdrop"_n, &token::claimdrop>;
 
       private:
+         // Fields added later to the contract-paid `tokenstats` or `tranches` rows are appended
+         // as `binary_extension` members, so existing rows still deserialize. `accounts` rows are
+         // billed to their owner or sender and must not grow on a credit the owner did not sign.
          struct [[eosio::table]] account {
             asset    balance;
-
             uint64_t primary_key()const { return balance.symbol.code().raw(); }
          };
 
+         /**
+          * Supply bookkeeping for a token. The symbol is stored once and every supply
+          * figure is a plain amount of that symbol, use `as_asset` to get an `asset` back.
+          */
          struct [[eosio::table]] currency_stats {
+            symbol   sym;
+            int64_t  cir_supply = 0;
+            int64_t  available_supply = 0;
+            int64_t  max_supply = 0;
+            int64_t  supply = 0;
+            int64_t  burn_supply = 0;
+            int64_t  block_supply = 0;
+            name     issuer;
+            asset as_asset( int64_t amount )const { return asset( amount, sym ); }
+
+            token_rules::supply_totals totals()const {
+               return { cir_supply, available_supply, max_supply, supply, burn_supply, block_supply };
+            }
+
+            void set_totals( const token_rules::supply_totals& t ) {
+               cir_supply       = t.cir_supply;
+               available_supply = t.available_supply;
+               max_supply       = t.max_supply;
+               supply           = t.supply;
+               burn_supply      = t.burn_supply;
+               block_supply     = t.block_supply;
+            }
+
+            uint64_t primary_key()const { return sym.code().raw(); }
+         };
+
+         /**
+          * Layout of the `stat` table written by deployments before `currency_stats`, every figure
+          * an `asset` and the tranche amounts inline. Only read by `convertstat`.
+          */
+         struct [[eosio::table]] legacy_currency_stats {
             asset    cir_supply;
             asset    available_supply;
             asset    max_supply;
@@ -205,41 +613,369 @@ namespace eosio {
 
             uint64_t primary_key()const { return supply.symbol.code().raw(); }
          };
-        string airdrop_wallet = "amzairdrop11";
-        string ico_wallet = "amzicowallet";
-        string history_s_h_wallet = "amazinghisto";
-        string inb_wallet = "inbnetwork11";
-        string history_n_l_s_wallet = "amzhistorsub";
-        string ddsfundation_wallet = "ddsfundation";
-        string market_ad_wallet = "marketingads";
-        string man_team_wallet = "amzmanagment";
-        string opt_cost_wallet = "amzhumanoper";
-        string history_s_f_wallet = "amzfollowers";
-	    uint64_t maxAirdrop = 300000000000000;
-	    uint64_t maxIco = 4600000000000000;
-	    uint64_t maxPreIco = 500000000000000;
-        uint64_t maxHistory_s_h = 500000000000000;
-        uint64_t maxInb = 10000000000000000;
-        uint64_t maxStakingCoin = 4000000000000000;
-       	uint64_t maxHistory_n_l_s = 100000000000000;
-        uint64_t maxddsfundation = 1000000000000000;
-        uint64_t maxMarket_ad = 1000000000000000;
-        uint64_t maxMan_team = 1000000000000000;
-        uint64_t maxOpt_cost = 700000000000000;
-        uint64_t maxHistory_s_f = 300000000000000;
-
-        //track time of function execute
-         uint64_t history_sh_function_time_lock = 1618464354;
-         uint64_t inb_function_time_lock = 86400;
-         uint64_t ddsfundation_function_time_lock = 31536000;
-         uint64_t market_ad_function_time_lock = 2592000;
-         uint64_t man_team_function_time_lock = 15768000;
 
-         typedef eosio::multi_index< "accounts"_n, account > accounts;
-         typedef eosio::multi_index< "stat"_n, currency_stats > stats;
+         /**
+          * Registry of every account holding a positive balance, scoped by token symbol code.
+          * It mirrors `accounts` so holder counts and rich lists are index walks over one scope;
+          * walk `bybalance` from the end for the largest holders first.
+          */
+         struct [[eosio::table]] holder {
+            name     owner;
+            int64_t  balance = 0;
 
+            uint64_t primary_key()const { return owner.value; }
+            uint64_t by_balance()const { return static_cast<uint64_t>( balance ); }
+         };
+
+         /**
+          * Number of rows in the `holders` registry, scoped by token symbol code. Kept apart from
+          * the stats row so transfers that add or drop a holder never load the stats.
+          */
+         struct [[eosio::table]] holder_count {
+            uint64_t holders = 0;
+         };
+
+         /**
+          * Tokens of an account that cannot be spent before `unlock_time`, scoped by owner.
+          */
+         struct [[eosio::table]] balance_lock {
+            uint64_t id;
+            asset    quantity;
+            uint64_t unlock_time = 0;
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         /**
+          * Payment stream escrowed in the contract balance, stored in the contract scope.
+          * The amount owed to `payee` at any time is derived from `rate`, `start` and `stop`.
+          */
+         struct [[eosio::table]] payment_stream {
+            uint64_t id;
+            name     payer;
+            name     payee;
+            asset    rate;
+            uint64_t start = 0;
+            uint64_t stop = 0;
+            asset    withdrawn;
+
+            asset deposit()const { return asset( token_rules::streamed_amount( rate.amount, start, stop, stop ), rate.symbol ); }
+            asset accrued( uint64_t now )const { return asset( token_rules::streamed_amount( rate.amount, start, stop, now ), rate.symbol ); }
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         /**
+          * Part of the contract account balance held for open payment streams, stored in the
+          * contract scope. `sub_balance` never lets the contract account spend it.
+          */
+         struct [[eosio::table]] stream_escrow {
+            asset    balance;
+
+            uint64_t primary_key()const { return balance.symbol.code().raw(); }
+         };
+
+         /**
+          * Tranche release queued by `schedule`, stored in the contract scope.
+          */
+         struct [[eosio::table]] scheduled_release {
+            uint64_t id;
+            uint64_t due = 0;
+            name     tranche;
+            asset    quantity;
+
+            uint64_t primary_key()const { return id; }
+            uint64_t by_due()const { return due; }
+         };
+
+         /**
+          * Kind of a balance movement recorded in the activity log.
+          */
+         enum activity_kind : uint8_t {
+            transfer_activity,
+            burn_activity,
+            issue_activity,
+            block_activity,
+            unblock_activity,
+            settle_activity,
+            stream_activity
+         };
+
+#ifdef TOKEN_ACTIVITY_LOG
+         /**
+          * One slot of the activity ring buffer, enabled by building with `-DTOKEN_ACTIVITY_LOG`.
+          * Record `seq` lives in slot `seq % activity_log_size` and is overwritten in place once the
+          * ring wraps. An empty `from` marks a credit without counterparty (unblock, settle credit),
+          * an empty `to` a debit without one (burn, block, settle debit). Issues carry the tranche
+          * id in `from`.
+          */
+         struct [[eosio::table]] activity_record {
+            uint64_t slot;
+            uint64_t seq = 0;
+            name     from;
+            name     to;
+            asset    quantity;
+            uint8_t  kind = 0;
+
+            uint64_t primary_key()const { return slot; }
+         };
+
+         /**
+          * Sequence number of the next activity record, indexers poll it to find new records.
+          */
+         struct [[eosio::table]] activity_state {
+            uint64_t next_seq = 0;
+         };
+#endif
+
+         /**
+          * Supply figures of a token at `time`, in seconds since epoch.
+          */
+         struct supply_sample {
+            uint64_t time = 0;
+            int64_t  supply = 0;
+            int64_t  cir_supply = 0;
+            int64_t  burn_supply = 0;
+            int64_t  block_supply = 0;
+         };
+
+         /**
+          * One slot of the fine-grained supply ring, scoped by token symbol code. Interval
+          * `bucket` lives in slot `bucket % checkpoint_slots` and is overwritten in place once
+          * the ring wraps, so the ring covers the last `checkpoint_slots` intervals.
+          */
+         struct [[eosio::table]] ring_checkpoint {
+            uint64_t       slot;
+            uint64_t       bucket = 0;
+            supply_sample  sample;
+
+            uint64_t primary_key()const { return slot; }
+         };
+
+         /**
+          * One coarse supply checkpoint per `checkpoint_daily_interval`, scoped by token symbol
+          * code and kept forever.
+          */
+         struct [[eosio::table]] daily_checkpoint {
+            uint64_t       bucket;
+            supply_sample  sample;
+
+            uint64_t primary_key()const { return bucket; }
+         };
+
+         /**
+          * Totals of a completed audit pass. The pass is consistent when `balance_total` equals
+          * `cir_supply`, `tranche_total` equals `supply` and `registry_mismatches` is 0.
+          */
+         struct audit_result {
+            uint64_t completed = 0;
+            uint64_t scanned = 0;
+            uint64_t registry_mismatches = 0;
+            int64_t  balance_total = 0;
+            int64_t  cir_supply = 0;
+            int64_t  tranche_total = 0;
+            int64_t  supply = 0;
+         };
+
+         /**
+          * Progress of the running audit pass and result of the last completed one, scoped by
+          * token symbol code.
+          */
+         struct [[eosio::table]] audit_state {
+            name          cursor;
+            uint64_t      scanned = 0;
+            uint64_t      registry_mismatches = 0;
+            int64_t       balance_total = 0;
+            uint64_t      passes = 0;
+            audit_result  last_pass;
+         };
+
+         /**
+          * Symbol and precision of every token created by this contract, stored in the contract
+          * scope. This is all `transfer` needs, so the hot path never loads `currency_stats`.
+          */
+         struct [[eosio::table]] token_symbol {
+            symbol   sym;
+
+            uint64_t primary_key()const { return sym.code().raw(); }
+         };
+
+         /**
+          * One allocation tranche, scoped by token symbol code like `currency_stats`.
+          * `supply` is the amount released so far out of `max_supply`. Vesting tranches
+          * (`vest_duration` > 0) are paid out by `claim` instead of `release`.
+          */
+         struct [[eosio::table]] tranche_info {
+            name     id;
+            name     wallet;
+            int64_t  max_supply = 0;
+            int64_t  supply = 0;
+            uint64_t unlock_time = 0;
+            uint64_t lock_time = 0;
+            uint64_t last_time = 0;
+            uint64_t vest_start = 0;
+            uint64_t vest_cliff = 0;
+            uint64_t vest_duration = 0;
+            bool is_vesting()const { return vest_duration > 0; }
+
+            /**
+             * Amount of the tranche cap vested at `now`, computed on demand from the vesting schedule.
+             */
+            int64_t vested( uint64_t now )const {
+               return token_rules::vested_amount( max_supply, vest_start, vest_cliff, vest_duration, now );
+            }
+
+            uint64_t primary_key()const { return id.value; }
+         };
+         /**
+          * Merkle airdrop round, stored in the contract scope.
+          */
+         struct [[eosio::table]] drop_round {
+            uint64_t    id;
+            checksum256 root;
+            asset       total;
+            asset       claimed;
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         /**
+          * Claimed flags of an airdrop round, scoped by round id. Row `bucket` holds the flags
+          * of leaf indexes `bucket * 64` to `bucket * 64 + 63`, one bit each.
+          */
+         struct [[eosio::table]] drop_claims {
+            uint64_t bucket;
+            uint64_t bits = 0;
+
+            uint64_t primary_key()const { return bucket; }
+         };
+
+         /**
+          * Initial configuration of an allocation tranche, seeded into `tranches` by `create`.
+          */
+         struct tranche_default {
+            name     id;
+            name     wallet;
+            int64_t  max_supply;
+            uint64_t unlock_time;
+            uint64_t lock_time;
+         };
+
+         // resolved at compile time, constructing the contract for an action allocates nothing
+         static constexpr std::array<tranche_default, 12> default_tranches = {{
+            { "airdrop"_n,  "amzairdrop11"_n, 300000000000000,   0,          0 },
+            { "ico"_n,      "amzicowallet"_n, 4600000000000000,  0,          0 },
+            { "preico"_n,   "amzicowallet"_n, 500000000000000,   0,          0 },
+            { "histsh"_n,   "amazinghisto"_n, 500000000000000,   1618464354, 0 },
+            { "inb"_n,      "inbnetwork11"_n, 10000000000000000, 0,          86400 },
+            { "staking"_n,  name(),           4000000000000000,  0,          0 },
+            { "histnls"_n,  "amzhistorsub"_n, 100000000000000,   0,          0 },
+            { "ddsfund"_n,  "ddsfundation"_n, 1000000000000000,  0,          31536000 },
+            { "marketad"_n, "marketingads"_n, 1000000000000000,  0,          2592000 },
+            { "manteam"_n,  "amzmanagment"_n, 1000000000000000,  0,          15768000 },
+            { "optcost"_n,  "amzhumanoper"_n, 700000000000000,   0,          0 },
+            { "histsf"_n,   "amzfollowers"_n, 300000000000000,   0,          0 }
+         }};
+
+         static constexpr int64_t default_allocated_supply() {
+            int64_t allocated = 0;
+            for( const auto& t : default_tranches )
+               allocated += t.max_supply;
+            return allocated;
+         }
+
+         // bounds the lock rows sub_balance walks for one account
+         static constexpr uint32_t max_locks = 32;
+
+         // upper bound of the queued releases one crank call may process
+         static constexpr uint32_t max_crank_items = 50;
+
+         // upper bound of the holders one audit call may visit
+         static constexpr uint32_t max_audit_scopes = 100;
+
+         // upper bound of the owners one addholders call may register
+         static constexpr uint32_t max_holder_backfill = 100;
+
+         // supply checkpoints, by default hourly for 30 days in a ring and daily forever
+         static constexpr uint64_t checkpoint_interval = TOKEN_CHECKPOINT_INTERVAL;
+         static constexpr uint64_t checkpoint_slots = TOKEN_CHECKPOINT_SLOTS;
+         static constexpr uint64_t checkpoint_daily_interval = TOKEN_CHECKPOINT_DAILY_INTERVAL;
+         static_assert( checkpoint_interval > 0 && checkpoint_slots > 0, "supply checkpoint ring must not be empty" );
+         // a daily checkpoint is only looked up when a new ring interval starts
+         static_assert( checkpoint_daily_interval % checkpoint_interval == 0, "daily interval must be a multiple of the ring interval" );
+
+#ifdef TOKEN_ACTIVITY_LOG
+         // number of slots of the activity ring buffer, RAM use stays constant once it is full
+         static constexpr uint64_t activity_log_size = TOKEN_ACTIVITY_LOG_SIZE;
+#endif
+
+#ifdef TOKEN_METRICS
+         typedef metered_index< "accounts"_n, account, &token_metrics::accounts > accounts;
+         typedef metered_index< "tokenstats"_n, currency_stats, &token_metrics::stats > stats;
+         typedef metered_index< "tranches"_n, tranche_info, &token_metrics::tranches > tranches;
+         typedef metered_index< "symbols"_n, token_symbol, &token_metrics::symbols > symbols;
+         typedef metered_index< "holders"_n, holder, &token_metrics::holders,
+            indexed_by< "bybalance"_n, const_mem_fun< holder, uint64_t, &holder::by_balance > >
+         > holders;
+         typedef metered_index< "locks"_n, balance_lock, &token_metrics::locks > locks;
+
+         // Shadows eosio::check inside the contract so every evaluated check is counted.
+         static void check( bool pred, const char* msg ) {
+            ++action_metrics.checks;
+            eosio::check( pred, msg );
+         }
+#else
+         typedef eosio::multi_index< "accounts"_n, account > accounts;
+         typedef eosio::multi_index< "tokenstats"_n, currency_stats > stats;
+         typedef eosio::multi_index< "tranches"_n, tranche_info > tranches;
+         typedef eosio::multi_index< "symbols"_n, token_symbol > symbols;
+         typedef eosio::multi_index< "holders"_n, holder,
+            indexed_by< "bybalance"_n, const_mem_fun< holder, uint64_t, &holder::by_balance > >
+         > holders;
+         typedef eosio::multi_index< "locks"_n, balance_lock > locks;
+#endif
+         typedef eosio::singleton< "holdercount"_n, holder_count > holder_counter;
+         typedef eosio::multi_index< "stat"_n, legacy_currency_stats > legacy_stats;
+         typedef eosio::multi_index< "streams"_n, payment_stream > streams;
+         typedef eosio::multi_index< "escrow"_n, stream_escrow > escrows;
+         typedef eosio::singleton< "audit"_n, audit_state > audit_cursor;
+#ifdef TOKEN_ACTIVITY_LOG
+         typedef eosio::multi_index< "activity"_n, activity_record > activity_log;
+         typedef eosio::singleton< "actstate"_n, activity_state > activity_cursor;
+#endif
+         typedef eosio::multi_index< "schedule"_n, scheduled_release,
+            indexed_by< "bydue"_n, const_mem_fun< scheduled_release, uint64_t, &scheduled_release::by_due > >
+         > releases;
+         typedef eosio::multi_index< "droprounds"_n, drop_round > droprounds;
+         typedef eosio::multi_index< "supplyring"_n, ring_checkpoint > supply_ring;
+         typedef eosio::multi_index< "supplydaily"_n, daily_checkpoint > supply_daily;
+         typedef eosio::multi_index< "dropclaims"_n, drop_claims > dropclaims;
+
+         // aborts with the message of a failed token_rules check
+         static void check_rule( const char* error ) { check( error == nullptr, error ); }
+
+         symbol deployed_symbol()const;
+         void register_symbol( const symbol& sym );
+#ifdef TOKEN_ACTIVITY_LOG
+         // activity cursor loaded by the first record of an action, written back once by the destructor
+         std::optional<activity_state> activity_pending;
+
+         void log_activity( activity_kind kind, const name& from, const name& to, const asset& quantity );
+         void flush_activity();
+#else
+         void log_activity( activity_kind, const name&, const name&, const asset& ) {}
+#endif
          void sub_balance( const name& owner, const asset& value );
          void add_balance( const name& owner, const asset& value, const name& ram_payer );
+         int64_t locked_balance( const name& owner, const symbol& sym );
+         int64_t escrowed_balance( const symbol& sym );
+         void update_escrow( const asset& delta );
+         int64_t sync_holder( holders& holdertable, const name& owner, int64_t balance, const name& ram_payer );
+         void add_holders( const symbol_code& sym_code, int64_t delta );
+         void update_holder( const name& owner, const asset& balance, const name& ram_payer );
+         void record_checkpoint( const currency_stats& st );
+         void mint_tranche( tranches& tranchetable, const tranche_info& tr, const asset& quantity );
+         void issue_tranche( tranches& tranchetable, const tranche_info& tr, const name& to, const asset& quantity, const name& ram_payer );
    };
 
 }
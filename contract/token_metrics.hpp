@@ -0,0 +1,129 @@
+#pragma once
+
+#include <eosio/eosio.hpp>
+#include <eosio/multi_index.hpp>
+#include <eosio/print.hpp>
+
+#ifdef TOKEN_METRICS
+
+namespace eosio {
+
+   /**
+    * Number of calls made on one table during the current action.
+    */
+   struct table_counters {
+      uint32_t find = 0;
+      uint32_t get = 0;
+      uint32_t emplace = 0;
+      uint32_t modify = 0;
+      uint32_t erase = 0;
+   };
+
+   /**
+    * Per-action resource counters of the token contract, only compiled in when building
+    * with `-DTOKEN_METRICS`. Contract memory is reset for every action, so every action
+    * starts counting from zero. Byte counts use the packed size of the rows touched.
+    */
+   struct token_metrics {
+      table_counters accounts;
+      table_counters stats;
+      table_counters tranches;
+      table_counters symbols;
+      table_counters holders;
+      table_counters locks;
+      uint64_t       bytes_packed = 0;
+      uint64_t       bytes_unpacked = 0;
+      uint32_t       checks = 0;
+   };
+
+   inline token_metrics action_metrics;
+
+   /**
+    * Drop-in replacement for `multi_index` that records its calls in `action_metrics`.
+    * Only the calls made by the token contract are wrapped.
+    */
+   template<name::raw TableName, typename T, table_counters token_metrics::*Counters, typename... Indices>
+   class metered_index : public multi_index<TableName, T, Indices...> {
+      using base = multi_index<TableName, T, Indices...>;
+
+      static table_counters& counters() { return action_metrics.*Counters; }
+
+      public:
+         using typename base::const_iterator;
+         using base::base;
+
+         const_iterator find( uint64_t primary )const {
+            ++counters().find;
+            auto itr = base::find( primary );
+            if( itr != base::end() )
+               action_metrics.bytes_unpacked += pack_size( *itr );
+            return itr;
+         }
+
+         const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const {
+            ++counters().get;
+            const auto& obj = base::get( primary, error_msg );
+            action_metrics.bytes_unpacked += pack_size( obj );
+            return obj;
+         }
+
+         template<typename Lambda>
+         const_iterator emplace( name payer, Lambda&& constructor ) {
+            ++counters().emplace;
+            auto itr = base::emplace( payer, std::forward<Lambda>(constructor) );
+            action_metrics.bytes_packed += pack_size( *itr );
+            return itr;
+         }
+
+         template<typename Lambda>
+         void modify( const_iterator itr, name payer, Lambda&& updater ) {
+            modify( *itr, payer, std::forward<Lambda>(updater) );
+         }
+
+         template<typename Lambda>
+         void modify( const T& obj, name payer, Lambda&& updater ) {
+            ++counters().modify;
+            base::modify( obj, payer, std::forward<Lambda>(updater) );
+            action_metrics.bytes_packed += pack_size( obj );
+         }
+
+         const_iterator erase( const_iterator itr ) {
+            ++counters().erase;
+            return base::erase( itr );
+         }
+
+         void erase( const T& obj ) {
+            ++counters().erase;
+            base::erase( obj );
+         }
+   };
+
+   inline void print_table_counters( const char* table, const table_counters& c ) {
+      print( "\"", table, "\":{\"find\":", c.find, ",\"get\":", c.get, ",\"emplace\":", c.emplace,
+             ",\"modify\":", c.modify, ",\"erase\":", c.erase, "}" );
+   }
+
+   /**
+    * Prints the counters of the current action as a single JSON console line.
+    */
+   inline void print_token_metrics() {
+      const auto& m = action_metrics;
+      print( "{\"token_metrics\":{" );
+      print_table_counters( "accounts", m.accounts );
+      print( "," );
+      print_table_counters( "tokenstats", m.stats );
+      print( "," );
+      print_table_counters( "tranches", m.tranches );
+      print( "," );
+      print_table_counters( "symbols", m.symbols );
+      print( "," );
+      print_table_counters( "holders", m.holders );
+      print( "," );
+      print_table_counters( "locks", m.locks );
+      print( ",\"bytes_packed\":", m.bytes_packed, ",\"bytes_unpacked\":", m.bytes_unpacked,
+             ",\"checks\":", m.checks, "}}\n" );
+   }
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Balance and supply rules of the token contract as plain functions over amounts, free of
+ * eosio tables and intrinsics: debits against reserved balance, tranche issue, burn, block
+ * and unblock of the supply totals, linear vesting, pro rata staking shares and stream
+ * accrual. The contract computes these through this header, so off-chain code including it
+ * gets the same amounts.
+ *
+ * Argument validation (positive amounts, symbol and precision, memo length, no transfer to
+ * self), authorization, settle's zero-sum rule and what counts as reserved balance stay in
+ * the contract; a ledger mirror has to apply those from token.cpp itself.
+ *
+ * Check functions return nullptr when the operation is allowed and otherwise the message
+ * the contract aborts with. Apply functions expect the matching check to have passed.
+ */
+namespace token_rules {
+
+   /**
+    * Supply totals of one token, mirrored by `currency_stats`.
+    */
+   struct supply_totals {
+      int64_t cir_supply = 0;
+      int64_t available_supply = 0;
+      int64_t max_supply = 0;
+      int64_t supply = 0;
+      int64_t burn_supply = 0;
+      int64_t block_supply = 0;
+   };
+
+   /**
+    * Debiting `amount` from a balance of which `reserved` cannot be spent: the unexpired locks
+    * of the owner and, for the contract account, the stream escrow.
+    */
+   constexpr const char* check_debit( int64_t balance, int64_t reserved, int64_t amount ) {
+      if( balance < amount )
+         return "overdrawn balance";
+      if( balance - reserved < amount )
+         return "balance is locked";
+      return nullptr;
+   }
+
+   /**
+    * Minting `amount` out of a tranche capped at `tranche_max` that already released `tranche_supply`.
+    */
+   constexpr const char* check_issue( const supply_totals& totals, int64_t tranche_max, int64_t tranche_supply, int64_t amount ) {
+      if( amount > tranche_max - tranche_supply )
+         return "quantity exceeds available tranche supply";
+      if( amount > totals.max_supply - totals.supply )
+         return "quantity exceeds available supply";
+      return nullptr;
+   }
+
+   constexpr void apply_issue( supply_totals& totals, int64_t amount ) {
+      totals.supply += amount;
+      totals.cir_supply += amount;
+   }
+
+   /**
+    * Taking `amount` out of circulation, shared by burn and block.
+    */
+   constexpr const char* check_retire( const supply_totals& totals, int64_t amount ) {
+      if( amount > totals.cir_supply )
+         return "quantity exceeds available circulating supply";
+      return nullptr;
+   }
+
+   constexpr void apply_burn( supply_totals& totals, int64_t amount ) {
+      totals.cir_supply -= amount;
+      totals.available_supply -= amount;
+      totals.burn_supply += amount;
+   }
+
+   constexpr void apply_block( supply_totals& totals, int64_t amount ) {
+      totals.cir_supply -= amount;
+      totals.block_supply += amount;
+   }
+
+   constexpr const char* check_unblock( const supply_totals& totals, int64_t amount ) {
+      if( amount > totals.block_supply )
+         return "quantity exceeds available blocked token";
+      return nullptr;
+   }
+
+   constexpr void apply_unblock( supply_totals& totals, int64_t amount ) {
+      totals.cir_supply += amount;
+      totals.block_supply -= amount;
+   }
+
+   /**
+    * Amount of `max_supply` vested at `now` under a linear schedule with a cliff.
+    */
+   constexpr int64_t vested_amount( int64_t max_supply, uint64_t start, uint64_t cliff, uint64_t duration, uint64_t now ) {
+      if( duration == 0 || now < start || now - start < cliff )
+         return 0;
+      uint64_t elapsed = std::min( now - start, duration );
+      return static_cast<int64_t>( static_cast<unsigned __int128>( max_supply ) * elapsed / duration );
+   }
+
+   /**
+    * Amount accrued at `now` by a stream paying `rate` per second from `start` to `stop`.
+    */
+   constexpr int64_t streamed_amount( int64_t rate, uint64_t start, uint64_t stop, uint64_t now ) {
+      if( now <= start )
+         return 0;
+      return rate * static_cast<int64_t>( std::min( now, stop ) - start );
+   }
+
+   /**
+    * Rounded-down pro rata share of `total` owed to the first entries of a list whose weights
+    * add up to `cumulative_weight` out of `total_weight`. The share of one entry is the
+    * difference of two consecutive cumulative shares, so the shares add up to exactly `total`.
+    */
+   constexpr int64_t cumulative_share( int64_t total, uint64_t cumulative_weight, uint64_t total_weight ) {
+      return static_cast<int64_t>( static_cast<unsigned __int128>( total ) * cumulative_weight / total_weight );
+   }
+
+}